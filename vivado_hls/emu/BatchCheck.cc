@@ -0,0 +1,263 @@
+#include <stdint.h>
+
+#include <iostream>
+#include <vector>
+
+#include "BatchCheck.hh"
+#include "EventBatch.hh"
+#include "EventRunner.hh"
+#include "FrameCache.hh"
+#include "IncrementalCard.hh"
+#include "LinkFormat.hh"
+
+using namespace std;
+
+namespace {
+
+// 64 bit xorshift, for reproducible random inputs
+struct Random {
+   uint64_t s;
+   Random() : s(0x9E3779B97F4A7C15ull) {}
+   uint64_t next() { s ^= s << 13; s ^= s >> 7; s ^= s << 17; return s; }
+};
+
+const int NTowers = TowerOccupancy::NTowers;
+const int NCrystalsPerTower = NCrystalsPerEtaPhi * NCrystalsPerEtaPhi;
+
+// Random card: empty, one occupied tower, one occupied region, sparse or full
+// (kind 0 ... 4, random if -1), with crystal ET below 16 (noise) or up to 1023
+void setCard(Random &rnd, uint16_t crystals[NCrystalsPerCard], int kind = -1) {
+   if (kind < 0) kind = rnd.next() % 5;
+   int region = rnd.next() % RCTCard::NRegions;
+   int tower = rnd.next() % NTowers;
+   for (int t = 0; t < NTowers; t++) {
+      bool occupied = kind == 1 ? t == tower :
+	 kind == 2 ? t / NTowersPer3x4Region == region :
+	 kind == 3 ? rnd.next() % 8 == 0 : kind == 4;
+      for (int c = 0; c < NCrystalsPerTower; c++) {
+	 uint64_t r = rnd.next();
+	 crystals[t * NCrystalsPerTower + c] = occupied && (r & 3) == 0 ? ((r >> 8) & 1 ? (r >> 16) & 0xF : (r >> 16) & 0x3FF) : 0;
+      }
+   }
+}
+
+// kind: of the cards, as for setCard
+bool sameAsPerEvent(uint64_t nEvents, size_t nBatch, uint16_t noiseThreshold, int kind = -1) {
+   Random rnd;
+   vector<uint16_t> crystals(nBatch * NCrystalsPerCard);
+   vector<TowerOccupancy> occupancy(nBatch);
+   ClusterColumns batch, dense;
+   uint16_t expected[6][NClustersPerCard];
+   for (uint64_t first = 0; first < nEvents; first += nBatch) {
+      for (size_t event = 0; event < nBatch; event++) {
+	 setCard(rnd, &crystals[event * NCrystalsPerCard], kind);
+	 getTowerOccupancy(&crystals[event * NCrystalsPerCard], noiseThreshold, occupancy[event]);
+      }
+      getClustersInCards(&crystals[0], nBatch, batch, &occupancy[0]);
+      if (noiseThreshold == 0)
+	 getClustersInCards(&crystals[0], nBatch, dense);
+
+      for (size_t event = 0; event < nBatch; event++) {
+	 // The towers below the noise threshold zeroed
+	 uint16_t card[NCrystalsPerCard];
+	 for (int t = 0; t < NTowers; t++)
+	    for (int c = 0; c < NCrystalsPerTower; c++)
+	       card[t * NCrystalsPerTower + c] = occupancy[event].occupied(t) ? crystals[event * NCrystalsPerCard + t * NCrystalsPerTower + c] : 0;
+	 for (int f = 0; f < 6; f++)
+	    for (int i = 0; i < NClustersPerCard; i++)
+	       expected[f][i] = 0;
+	 getClustersInCard<RCTCard>(card, expected[0], expected[1], expected[2], expected[3], expected[4], expected[5]);
+
+	 const vector<uint16_t> *fields[6] = { &batch.peakEta, &batch.peakPhi, &batch.towerEta, &batch.towerPhi,
+	    &batch.towerET, &batch.ET };
+	 const vector<uint16_t> *denseFields[6] = { &dense.peakEta, &dense.peakPhi, &dense.towerEta, &dense.towerPhi,
+	    &dense.towerET, &dense.ET };
+	 for (int f = 0; f < 6; f++) {
+	    for (int i = 0; i < NClustersPerCard; i++) {
+	       size_t k = event * NClustersPerCard + i;
+	       if ((*fields[f])[k] != expected[f][i] || (noiseThreshold == 0 && (*denseFields[f])[k] != expected[f][i])) {
+		  cout << "getClustersInCards (noise threshold " << noiseThreshold << ") differs from getClustersInCard in field "
+		     << f << " of cluster " << i << " of a card with " << occupancy[event].count() << " occupied towers" << endl;
+		  return false;
+	       }
+	    }
+	 }
+      }
+   }
+   cout << "getClustersInCards (noise threshold " << noiseThreshold << ") same as getClustersInCard on " << nEvents
+      << (kind == 0 ? " empty" : kind == 4 ? " full" : " random") << " cards in batches of " << nBatch << endl;
+   return true;
+}
+
+// Next event of a slowly varying card: unchanged, a few crystals changed, or a new card
+void stepCard(Random &rnd, uint16_t crystals[NCrystalsPerCard]) {
+   int kind = rnd.next() % 8;
+   if (kind == 0)
+      setCard(rnd, crystals);
+   else if (kind < 6) {
+      for (int i = 0; i < kind; i++) {
+	 uint64_t r = rnd.next();
+	 crystals[r % NCrystalsPerCard] = (r >> 32) & 0x3FF;
+      }
+   }
+}
+
+// IncrementalCard against getClustersInCard on a slowly varying card, reset every
+// resetEvery events
+bool incrementalSameAsFull(uint64_t nEvents, uint64_t resetEvery) {
+   Random rnd;
+   IncrementalCard card;
+   uint16_t crystals[NCrystalsPerCard];
+   uint16_t expected[6][NClustersPerCard], found[6][NClustersPerCard];
+   setCard(rnd, crystals);
+   uint64_t nFailures = 0;
+   for (uint64_t event = 0; event < nEvents; event++) {
+      if (event % resetEvery == 0)
+	 card.reset();
+      stepCard(rnd, crystals);
+      for (int f = 0; f < 6; f++)
+	 for (int i = 0; i < NClustersPerCard; i++)
+	    expected[f][i] = found[f][i] = 0;
+      bool expectedOk = getClustersInCard<RCTCard>(crystals, expected[0], expected[1], expected[2], expected[3],
+	    expected[4], expected[5]);
+      bool foundOk = card.getClusters(crystals, found[0], found[1], found[2], found[3], found[4], found[5]);
+      nFailures += !expectedOk;
+      bool same = foundOk == expectedOk;
+      for (int f = 0; f < 6; f++)
+	 for (int i = 0; i < NClustersPerCard; i++)
+	    same &= found[f][i] == expected[f][i];
+      if (!same) {
+	 cout << "IncrementalCard differs from getClustersInCard at event " << event << endl;
+	 return false;
+      }
+   }
+   cout << "IncrementalCard same as getClustersInCard on " << nEvents << " slowly varying cards (reset every "
+      << resetEvery << ", " << card.nRecomputed() << " of " << card.nRegions() << " regions recomputed, "
+      << nFailures << " failures)" << endl;
+   return true;
+}
+
+// Input links of a card
+void setFrame(const uint16_t crystals[NCrystalsPerCard], ap_uint<192> link_in[N_CH_IN]) {
+   for (int link = 0; link < N_CH_IN; link++)
+      link_in[link] = 0;
+   for (int crystalID = 0; crystalID < NCrystalsPerCard; crystalID++) {
+      int bitLo = (crystalID % NCrystalsPerLink + 1) * 16;
+      link_in[crystalID / NCrystalsPerLink].range(bitLo + 15, bitLo) = crystals[crystalID];
+   }
+}
+
+// Input links of a random card
+void setFrame(Random &rnd, ap_uint<192> link_in[N_CH_IN]) {
+   uint16_t crystals[NCrystalsPerCard];
+   setCard(rnd, crystals);
+   setFrame(crystals, link_in);
+}
+
+// EventRunner in incremental mode on several threads against the batched mode, on
+// a slowly varying card
+bool incrementalRunSameAsBatched(size_t nEvents, size_t grain) {
+   Random rnd;
+   uint16_t crystals[NCrystalsPerCard];
+   setCard(rnd, crystals);
+   vector<ap_uint<192> > in(nEvents * N_CH_IN), out(nEvents * N_CH_OUT), incrementalOut(nEvents * N_CH_OUT);
+   for (size_t event = 0; event < nEvents; event++) {
+      stepCard(rnd, crystals);
+      setFrame(crystals, &in[event * N_CH_IN]);
+   }
+
+   EventRunner runner(1, false, grain, EventRunner::Batched);
+   EventRunner incrementalRunner(4, false, grain, EventRunner::Incremental);
+   bool success = runner.run(&in[0], nEvents, &out[0]);
+   bool incrementalSuccess = incrementalRunner.run(&in[0], nEvents, &incrementalOut[0]);
+   if (incrementalOut != out || incrementalSuccess != success) {
+      cout << "EventRunner in incremental mode differs from the batched mode" << endl;
+      return false;
+   }
+   cout << "EventRunner in incremental mode same as batched on " << nEvents << " slowly varying frames (batches of "
+      << grain << ", " << incrementalRunner.nRegionsRecomputed() << " of " << incrementalRunner.nRegions()
+      << " regions recomputed)" << endl;
+   return true;
+}
+
+// Least recently used eviction and counters of a one shard cache of 4 frames
+bool cacheEvictsLeastRecentlyUsed() {
+   Random rnd;
+   const int N = 6;
+   vector<ap_uint<192> > in(N * N_CH_IN), out(N * N_CH_OUT), found(N_CH_OUT);
+   for (int f = 0; f < N; f++) {
+      setFrame(rnd, &in[f * N_CH_IN]);
+      in[f * N_CH_IN].range(31, 16) = f + 1;  // distinct frames
+      for (int link = 0; link < N_CH_OUT; link++)
+	 out[f * N_CH_OUT + link] = f * N_CH_OUT + link;
+   }
+   FrameCache cache(4, 1);
+   for (int f = 0; f < 4; f++)
+      cache.insert(&in[f * N_CH_IN], &out[f * N_CH_OUT]);
+   bool ok = cache.lookup(&in[0], &found[0]) && found[N_CH_OUT - 1] == out[N_CH_OUT - 1];  // frame 0 used last
+   cache.insert(&in[4 * N_CH_IN], &out[4 * N_CH_OUT]);   // evicts frame 1
+   cache.insert(&in[5 * N_CH_IN], &out[5 * N_CH_OUT]);   // evicts frame 2
+   ok &= !cache.lookup(&in[1 * N_CH_IN], &found[0]) && !cache.lookup(&in[2 * N_CH_IN], &found[0]);
+   for (int f : { 0, 3, 4, 5 })
+      ok &= cache.lookup(&in[f * N_CH_IN], &found[0]) && std::equal(found.begin(), found.end(), &out[f * N_CH_OUT]);
+   FrameCache::Stats s = cache.stats();
+   ok &= cache.size() == 4 && s.lookups == 7 && s.hits == 5 && s.insertions == 6 && s.evictions == 2;
+   if (!ok) {
+      cout << "FrameCache does not evict the least recently used frame" << endl;
+      return false;
+   }
+   cout << "FrameCache evicts the least recently used frame and counts its lookups" << endl;
+   return true;
+}
+
+// EventRunner with a cache of cacheSize frames against the runner without, on
+// nEvents frames drawn from 40 distinct ones
+bool cachedRunSameAsUncached(size_t nEvents, size_t cacheSize, size_t grain, bool perEvent) {
+   Random rnd;
+   const int NDistinct = 40;
+   vector<ap_uint<192> > distinct(NDistinct * N_CH_IN);
+   for (int f = 0; f < NDistinct; f++)
+      setFrame(rnd, &distinct[f * N_CH_IN]);
+   vector<ap_uint<192> > in(nEvents * N_CH_IN), out(nEvents * N_CH_OUT), cachedOut(nEvents * N_CH_OUT);
+   for (size_t event = 0; event < nEvents; event++) {
+      int f = rnd.next() % NDistinct;
+      std::copy_n(&distinct[f * N_CH_IN], N_CH_IN, &in[event * N_CH_IN]);
+   }
+
+   FrameCache cache(cacheSize, 4);
+   EventRunner::Mode mode = perEvent ? EventRunner::PerEvent : EventRunner::Batched;
+   EventRunner runner(1, false, grain, mode);
+   EventRunner cachedRunner(4, false, grain, mode, 0, &cache);
+   runner.run(&in[0], nEvents, &out[0]);
+   for (int pass = 0; pass < 2; pass++) {
+      cachedRunner.run(&in[0], nEvents, &cachedOut[0]);
+      if (cachedOut != out) {
+	 cout << "EventRunner with a cache of " << cacheSize << " frames differs from the runner without" << endl;
+	 return false;
+      }
+   }
+   FrameCache::Stats s = cache.stats();
+   cout << "EventRunner with a cache of " << cacheSize << " frames same as without on 2 x " << nEvents << " frames ("
+      << (perEvent ? "per event, " : "batches of ") ;
+   if (!perEvent) cout << grain << ", ";
+   cout << s.hits << " hits, " << s.repeats << " batch repeats, " << s.evictions << " evictions)" << endl;
+   return true;
+}
+
+}
+
+bool checkBatch() {
+   bool ok = true;
+   ok &= sameAsPerEvent(1 << 14, 255, 0);
+   ok &= sameAsPerEvent(1 << 12, 1, 0);
+   ok &= sameAsPerEvent(1 << 14, 255, 15);
+   ok &= sameAsPerEvent(1 << 10, 64, 0, 0);   // no occupied tower or region in the batch
+   ok &= sameAsPerEvent(1 << 12, 64, 15, 4);  // dense batches, with towers at or below the threshold
+   ok &= cacheEvictsLeastRecentlyUsed();
+   ok &= cachedRunSameAsUncached(4000, 64, 37, false);
+   ok &= cachedRunSameAsUncached(4000, 8, 37, false);
+   ok &= cachedRunSameAsUncached(2000, 16, 10, true);
+   ok &= incrementalSameAsFull(1 << 14, 1000);
+   ok &= incrementalRunSameAsBatched(4000, 37);
+   return ok;
+}
@@ -0,0 +1,22 @@
+#ifndef BatchCheck_hh
+#define BatchCheck_hh
+
+/*
+ * Self checks of the batched entry points of EventBatch.hh and EventRunner.hh
+ * (rct_emu --check-batch):
+ *  - getClustersInCards, with and without the tower occupancy of the events,
+ *    against getClustersInCard of each event, on batches mixing empty cards, cards
+ *    with a single occupied tower or region, sparse and fully occupied cards, and
+ *    on batches of empty cards only;
+ *  - with a noise threshold, against getClustersInCard of the events whose towers
+ *    holding only crystals at or below it were zeroed;
+ *  - least recently used eviction and counters of FrameCache, and EventRunner on
+ *    several threads sharing a cache (small enough to evict) against EventRunner
+ *    without, on streams repeating a few frames;
+ *  - IncrementalCard against getClustersInCard, and EventRunner in incremental
+ *    mode against the batched mode, on cards changing a few crystals at a time.
+ * Prints a line per check; false if any failed.
+ */
+bool checkBatch();
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef BitVector_hh
+#define BitVector_hh
+
+#include <stdint.h>
+
+#include <istream>
+
+/*
+ * Fixed width unsigned bit vector (up to 192 bits) stored in three uint64_t words.
+ *
+ * It implements the subset of ap_uint<W> that algo_unpacked and its testbenches
+ * use (construction from integers, range(hi, lo) read and write, to_int64, stream
+ * extraction) with the same truncation semantics, so that the emulator can build
+ * the unmodified HLS sources without the arbitrary precision library.
+ * Range extraction and insertion are constexpr and reduce to a few shifts and
+ * masks when hi/lo are known at compile time.
+ */
+
+template<int W>
+class BitVector {
+   static_assert(W > 0 && W <= 192, "BitVector supports 1 to 192 bits");
+
+public:
+   static constexpr int NWords = 3;
+
+   class RangeRef {
+   public:
+      constexpr RangeRef(BitVector &bv, int hi, int lo) : bv_(bv), hi_(hi), lo_(lo) {}
+
+      constexpr RangeRef &operator=(uint64_t v) { bv_.set(hi_, lo_, v); return *this; }
+      template<int N>
+      constexpr RangeRef &operator=(const BitVector<N> &v) {
+	 static_assert(N <= 64, "range assignment from more than 64 bits");
+	 bv_.set(hi_, lo_, v.to_uint64());
+	 return *this;
+      }
+      constexpr RangeRef &operator=(const RangeRef &r) { bv_.set(hi_, lo_, r.to_uint64()); return *this; }
+
+      constexpr operator uint64_t() const { return bv_.get(hi_, lo_); }
+      constexpr uint64_t to_uint64() const { return bv_.get(hi_, lo_); }
+      constexpr int64_t to_int64() const { return (int64_t) bv_.get(hi_, lo_); }
+
+   private:
+      BitVector &bv_;
+      int hi_;
+      int lo_;
+   };
+
+   constexpr BitVector() : w_{0, 0, 0} {}
+   constexpr BitVector(uint64_t v) : w_{v & wordMask(0), 0, 0} {}
+
+   // Bits [hi, lo] (hi - lo < 64) right aligned
+   constexpr uint64_t get(int hi, int lo) const {
+      int i = lo >> 6;
+      int s = lo & 63;
+      int n = hi - lo + 1;
+      uint64_t v = w_[i] >> s;
+      if (s != 0 && s + n > 64) v |= w_[i + 1] << (64 - s);
+      return n >= 64 ? v : (v & ((uint64_t(1) << n) - 1));
+   }
+
+   // Bits [hi, lo] = v, truncated to the range width (zero extended above 64 bits)
+   constexpr void set(int hi, int lo, uint64_t v) {
+      for (int i = lo >> 6; i <= (hi >> 6); i++) {
+	 int wLo = i * 64;
+	 int a = (lo > wLo ? lo : wLo) - wLo;
+	 int b = (hi < wLo + 63 ? hi : wLo + 63) - wLo;
+	 uint64_t m = (b - a == 63) ? ~uint64_t(0) : (((uint64_t(1) << (b - a + 1)) - 1) << a);
+	 int off = wLo + a - lo;
+	 uint64_t bits = off >= 64 ? 0 : ((v >> off) << a);
+	 w_[i] = (w_[i] & ~m) | (bits & m);
+      }
+   }
+
+   constexpr RangeRef range(int hi, int lo) { return RangeRef(*this, hi, lo); }
+   constexpr uint64_t range(int hi, int lo) const { return get(hi, lo); }
+
+   constexpr uint64_t word(int i) const { return w_[i]; }
+   constexpr void setWord(int i, uint64_t v) { w_[i] = v & wordMask(i); }
+
+   constexpr uint64_t to_uint64() const { return w_[0]; }
+   constexpr int64_t to_int64() const { return (int64_t) w_[0]; }
+
+   constexpr bool operator==(const BitVector &o) const { return w_[0] == o.w_[0] && w_[1] == o.w_[1] && w_[2] == o.w_[2]; }
+   constexpr bool operator!=(const BitVector &o) const { return !(*this == o); }
+
+private:
+   static constexpr uint64_t wordMask(int i) {
+      return W >= (i + 1) * 64 ? ~uint64_t(0) : (W <= i * 64 ? 0 : ((uint64_t(1) << (W - i * 64)) - 1));
+   }
+
+   uint64_t w_[NWords];
+};
+
+template<int W>
+std::istream &operator>>(std::istream &is, BitVector<W> &bv) {
+   uint64_t v;
+   if (is >> v) bv = BitVector<W>(v);
+   return is;
+}
+
+#endif
@@ -0,0 +1,195 @@
+#include <stdint.h>
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+
+#include "CardCheck.hh"
+#include "ClusterFinder.hh"
+#include "CrystalSums.hh"
+#include "EventBatch.hh"
+
+using namespace std;
+
+namespace {
+
+// 64 bit xorshift, for reproducible random inputs
+struct Random {
+   uint64_t s;
+   Random() : s(0x9E3779B97F4A7C15ull) {}
+   uint64_t next() { s ^= s << 13; s ^= s >> 7; s ^= s << 17; return s; }
+};
+
+const int NCrystalsPerTower = NCrystalsPerEtaPhi * NCrystalsPerEtaPhi;
+
+// Random card: sparse towers of small crystals, full towers of crystals up to 1023,
+// or crystals over the full 16 bits
+template<class Card>
+void setCard(Random &rnd, uint16_t crystals[Card::NCrystals]) {
+   int kind = rnd.next() % 3;
+   for (int t = 0; t < Card::NCrystals / NCrystalsPerTower; t++) {
+      bool occupied = kind != 0 || rnd.next() % 8 == 0;
+      for (int c = 0; c < NCrystalsPerTower; c++) {
+	 uint64_t r = rnd.next();
+	 crystals[t * NCrystalsPerTower + c] = !occupied ? 0 : kind == 0 ? r & 0xF : kind == 1 ? (r >> 16) & 0x3FF : r >> 48;
+      }
+   }
+}
+
+template<class Card>
+bool sumsSameAsTowers(const char *name, uint64_t nCards) {
+   Random rnd;
+   uint16_t crystals[Card::NCrystals];
+   Cluster expected[Card::NRegions][NTowersPer3x4Region], fromSums[Card::NRegions][NTowersPer3x4Region];
+   for (uint64_t card = 0; card < nCards; card++) {
+      setCard<Card>(rnd, crystals);
+      bool expectedOk = getMergedClustersInCard<Card>(crystals, expected);
+      bool ok = getMergedClustersInCardFromSums<Card>(crystals, fromSums);
+      for (int iRegion = 0; iRegion < Card::NRegions && ok == expectedOk; iRegion++) {
+	 for (int k = 0; k < NTowersPer3x4Region; k++) {
+	    if (fromSums[iRegion][k].data != expected[iRegion][k].data) {
+	       cout << "getMergedClustersInCardFromSums<" << name << "> differs from getMergedClustersInCard in cluster "
+		  << k << " of region " << iRegion << " of card " << card << endl;
+	       return false;
+	    }
+	 }
+      }
+      if (ok != expectedOk) {
+	 cout << "getMergedClustersInCardFromSums<" << name << "> " << (ok ? "succeeds" : "fails")
+	    << " on card " << card << ", getMergedClustersInCard does not" << endl;
+	 return false;
+      }
+   }
+   cout << "getMergedClustersInCardFromSums<" << name << "> same as getMergedClustersInCard on " << nCards
+      << " random cards" << endl;
+   return true;
+}
+
+// mergeClustersInCardSequential against mergeClustersInCard (the comparator network)
+// on the selected regions of random cards
+template<class Card>
+bool sequentialMergeSameAsNetwork(const char *name, uint64_t nCards) {
+   Random rnd;
+   uint16_t crystals[Card::NCrystals];
+   Cluster regionClusters[Card::NRegions][NTowersPer3x4Region];
+   uint16_t expected[6][Card::NClusters], sequential[6][Card::NClusters];
+   for (uint64_t card = 0; card < nCards; card++) {
+      setCard<Card>(rnd, crystals);
+      getMergedClustersInCard<Card>(crystals, regionClusters);
+      for (int iRegion = 0; iRegion < Card::NRegions; iRegion++)
+	 selectClustersInRegion(regionClusters[iRegion]);
+      mergeClustersInCard<Card>(regionClusters, expected[0], expected[1], expected[2], expected[3], expected[4], expected[5]);
+      mergeClustersInCardSequential<Card>(regionClusters, sequential[0], sequential[1], sequential[2], sequential[3],
+	    sequential[4], sequential[5]);
+      for (int f = 0; f < 6; f++) {
+	 for (int i = 0; i < Card::NClusters; i++) {
+	    if (sequential[f][i] != expected[f][i]) {
+	       cout << "mergeClustersInCardSequential<" << name << "> differs from mergeClustersInCard in field " << f
+		  << " of cluster " << i << " of card " << card << endl;
+	       return false;
+	    }
+	 }
+      }
+   }
+   cout << "mergeClustersInCardSequential<" << name << "> same as mergeClustersInCard on " << nCards
+      << " random cards" << endl;
+   return true;
+}
+
+struct ByET {
+   bool operator()(const Cluster &a, const Cluster &b) const { return b.et() < a.et(); }
+};
+
+struct ByData {
+   bool operator()(const Cluster &a, const Cluster &b) const { return a.data < b.data; }
+};
+
+struct SameData {
+   bool operator()(const Cluster &a, const Cluster &b) const { return a.data == b.data; }
+};
+
+// getClustersInCard<Card> against its definition: the NClustersPer3x4Region highest
+// ET clusters of each region, then all of them by decreasing ET, equal ET in region
+// order. The region clusters before the selection are those of getMergedClustersInCard;
+// the selection and the card sort are replaced by std::stable_sort. Of clusters of
+// equal ET at the selection cut of a region, any may be selected
+template<class Card>
+bool cardSameAsStableSort(const char *name, uint64_t nCards) {
+   Random rnd;
+   uint16_t crystals[Card::NCrystals];
+   Cluster regionClusters[Card::NRegions][NTowersPer3x4Region];
+   uint16_t field[6][Card::NClusters];
+   uint64_t nFailed = 0;
+   for (uint64_t card = 0; card < nCards; card++) {
+      setCard<Card>(rnd, crystals);
+      bool merged = getMergedClustersInCard<Card>(crystals, regionClusters);
+      bool ok = getClustersInCard<Card>(crystals, field[0], field[1], field[2], field[3], field[4], field[5]);
+      if (!merged || !ok) {
+	 if (merged != ok) {
+	    cout << "getClustersInCard<" << name << "> " << (ok ? "succeeds" : "fails") << " on card " << card
+	       << ", getMergedClustersInCard does not" << endl;
+	    return false;
+	 }
+	 nFailed++;
+	 continue;
+      }
+
+      Cluster out[Card::NClusters];
+      vector<Cluster> selected[Card::NRegions];
+      bool same = true;
+      for (int i = 0; i < Card::NClusters; i++) {
+	 out[i] = Cluster(field[5][i], field[4][i], field[2][i], field[3][i], field[0][i], field[1][i]);
+	 int iRegion = out[i].towerEta() / 3;
+	 if (iRegion >= Card::NRegions) {
+	    same = false;
+	    break;
+	 }
+	 selected[iRegion].push_back(out[i]);
+	 // Decreasing ET, equal ET in region order
+	 if (i > 0 && (out[i - 1].et() < out[i].et() ||
+		  (out[i - 1].et() == out[i].et() && out[i - 1].towerEta() / 3 > iRegion)))
+	    same = false;
+      }
+      for (int iRegion = 0; iRegion < Card::NRegions && same; iRegion++) {
+	 vector<Cluster> expected(regionClusters[iRegion], regionClusters[iRegion] + NTowersPer3x4Region);
+	 std::stable_sort(expected.begin(), expected.end(), ByET());
+	 uint16_t cut = expected[NClustersPer3x4Region - 1].et();
+	 // Above the cut, the same clusters; at the cut, as many of those of the region
+	 vector<Cluster> above, atCut, selectedAbove, selectedAtCut;
+	 for (const Cluster &c : expected) {
+	    if (c.et() > cut) above.push_back(c);
+	    else if (c.et() == cut) atCut.push_back(c);
+	 }
+	 for (const Cluster &c : selected[iRegion])
+	    (c.et() > cut ? selectedAbove : selectedAtCut).push_back(c);
+	 std::sort(above.begin(), above.end(), ByData());
+	 std::sort(selectedAbove.begin(), selectedAbove.end(), ByData());
+	 std::sort(atCut.begin(), atCut.end(), ByData());
+	 std::sort(selectedAtCut.begin(), selectedAtCut.end(), ByData());
+	 same = selected[iRegion].size() == NClustersPer3x4Region && above.size() == selectedAbove.size() &&
+	    std::equal(above.begin(), above.end(), selectedAbove.begin(), SameData()) &&
+	    std::includes(atCut.begin(), atCut.end(), selectedAtCut.begin(), selectedAtCut.end(), ByData());
+      }
+      if (!same) {
+	 cout << "getClustersInCard<" << name << "> differs from the stable sort of the selected regions on card "
+	    << card << endl;
+	 return false;
+      }
+   }
+   cout << "getClustersInCard<" << name << "> same as the stable sort of the selected regions on " << nCards
+      << " random cards (" << nFailed << " failures)" << endl;
+   return true;
+}
+
+}
+
+bool checkCards() {
+   bool ok = true;
+   ok &= sumsSameAsTowers<CTP7Card>("CTP7Card", 1 << 14);
+   ok &= sumsSameAsTowers<VU9PCard>("VU9PCard", 1 << 12);
+   ok &= sequentialMergeSameAsNetwork<CTP7Card>("CTP7Card", 1 << 14);
+   ok &= sequentialMergeSameAsNetwork<VU9PCard>("VU9PCard", 1 << 12);
+   ok &= cardSameAsStableSort<CTP7Card>("CTP7Card", 1 << 14);
+   ok &= cardSameAsStableSort<VU9PCard>("VU9PCard", 1 << 12);
+   return ok;
+}
@@ -0,0 +1,18 @@
+#ifndef CardCheck_hh
+#define CardCheck_hh
+
+/*
+ * Self checks of the card steps of ClusterFinder.hh and of their emulator variants
+ * (rct_emu --check-cards), for CTP7 and VU9P cards:
+ *  - getMergedClustersInCardFromSums (CrystalSums.hh) against getMergedClustersInCard,
+ *    on random cards with sparse or full towers and crystal ET over the full 16 bits
+ *    (wrapping sums) or small;
+ *  - mergeClustersInCardSequential (EventBatch.hh) against mergeClustersInCard, on
+ *    the selected region clusters of the same cards (many equal ET);
+ *  - getClustersInCard against a per-region selection and card sort done with
+ *    std::stable_sort, on the same cards.
+ * Prints a line per check; false if any failed.
+ */
+bool checkCards();
+
+#endif
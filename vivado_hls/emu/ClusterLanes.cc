@@ -0,0 +1,83 @@
+#include "ClusterLanes.hh"
+#include "ClusterLanesKernel.hh"
+
+LaneIsa bestLaneIsa() {
+   static const LaneIsa best =
+      laneIsaSupported(LaneAVX512) ? LaneAVX512 : laneIsaSupported(LaneAVX2) ? LaneAVX2 : LaneScalar;
+   return best;
+}
+
+bool laneIsaSupported(LaneIsa isa) {
+   switch (isa) {
+#if defined(RCT_EMU_AVX2) && (defined(__x86_64__) || defined(__i386__))
+   case LaneAVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+#if defined(RCT_EMU_AVX512) && (defined(__x86_64__) || defined(__i386__))
+   case LaneAVX512:
+      return __builtin_cpu_supports("avx512bw");
+#endif
+   case LaneScalar:
+      return true;
+   default:
+      return false;
+   }
+}
+
+const char *laneIsaName(LaneIsa isa) {
+   switch (isa) {
+   case LaneAVX2: return "avx2";
+   case LaneAVX512: return "avx512";
+   default: return "scalar";
+   }
+}
+
+void getClustersInTowers(const uint16_t *crystals, size_t nTowers,
+      uint16_t *peakEta, uint16_t *peakPhi, uint16_t *towerET, uint16_t *clusterET, LaneIsa isa) {
+   if (!laneIsaSupported(isa)) isa = LaneScalar;
+   switch (isa) {
+#ifdef RCT_EMU_AVX2
+   case LaneAVX2:
+      getClustersInTowersAVX2(crystals, nTowers, peakEta, peakPhi, towerET, clusterET);
+      break;
+#endif
+#ifdef RCT_EMU_AVX512
+   case LaneAVX512:
+      getClustersInTowersAVX512(crystals, nTowers, peakEta, peakPhi, towerET, clusterET);
+      break;
+#endif
+   default:
+      for (size_t tower = 0; tower < nTowers; tower++) {
+	 getClustersInTower(TowerView(&crystals[tower * RegionView::TowerStride]),
+	       &peakEta[tower], &peakPhi[tower], &towerET[tower], &clusterET[tower]);
+      }
+   }
+}
+
+void getClustersInTowers(const uint16_t *crystals, size_t nTowers,
+      uint16_t *peakEta, uint16_t *peakPhi, uint16_t *towerET, uint16_t *clusterET) {
+   getClustersInTowers(crystals, nTowers, peakEta, peakPhi, towerET, clusterET, bestLaneIsa());
+}
+
+void selectClustersInRegions(Cluster (*regionClusters)[NTowersPer3x4Region], size_t nRegions, LaneIsa isa) {
+   if (!laneIsaSupported(isa)) isa = LaneScalar;
+   switch (isa) {
+#ifdef RCT_EMU_AVX2
+   case LaneAVX2:
+      selectClustersInRegionsAVX2(regionClusters, nRegions);
+      break;
+#endif
+#ifdef RCT_EMU_AVX512
+   case LaneAVX512:
+      selectClustersInRegionsAVX512(regionClusters, nRegions);
+      break;
+#endif
+   default:
+      for (size_t region = 0; region < nRegions; region++)
+	 selectClustersInRegion(regionClusters[region]);
+   }
+}
+
+void selectClustersInRegions(Cluster (*regionClusters)[NTowersPer3x4Region], size_t nRegions) {
+   selectClustersInRegions(regionClusters, nRegions, bestLaneIsa());
+}
@@ -0,0 +1,48 @@
+#ifndef ClusterLanes_hh
+#define ClusterLanes_hh
+
+#include <stddef.h>
+
+#include "ClusterFinder.hh"
+
+/*
+ * Tower clustering and region cluster selections of many towers and regions at
+ * once, for the emulator.
+ *
+ * getClustersInTowers does getClustersInTower on each of nTowers towers, with one
+ * tower per vector lane: strip sums, tower ET, the weighted sums of getPeakBinOf5
+ * and the 3 strip cluster ET in 16 bit lanes, bit exact with the uint16_t
+ * arithmetic of the scalar code.
+ *
+ * selectClustersInRegions does selectClustersInRegion on each of nRegions
+ * sets of NTowersPer3x4Region clusters, with one region per vector lane: the
+ * compare-exchanges of the BitonicSelector network become unsigned 16 bit
+ * min/max on the ETs of 16 (AVX2) or 32 (AVX-512BW) regions and blends of their
+ * other fields. The comparators are the same and equal ETs are not swapped, so
+ * the NClustersPer3x4Region selected clusters are identical to those of
+ * selectClustersInRegion, ties included (the others are unspecified in both).
+ * The instruction set is picked at run time among those the build and the CPU
+ * support.
+ */
+
+enum LaneIsa { LaneScalar, LaneAVX2, LaneAVX512 };
+
+// Widest instruction set usable here
+LaneIsa bestLaneIsa();
+// false if the build or the CPU lacks it (LaneScalar is always supported)
+bool laneIsaSupported(LaneIsa isa);
+const char *laneIsaName(LaneIsa isa);
+
+// Towers of 5x5 crystals one after the other: crystals[tower * 25 + ceta * 5 + cphi],
+// as in a card (tower = tEta * NCaloLayer1Phi + tPhi) or a batch of cards
+void getClustersInTowers(const uint16_t *crystals, size_t nTowers,
+      uint16_t *peakEta, uint16_t *peakPhi, uint16_t *towerET, uint16_t *clusterET, LaneIsa isa);
+void getClustersInTowers(const uint16_t *crystals, size_t nTowers,
+      uint16_t *peakEta, uint16_t *peakPhi, uint16_t *towerET, uint16_t *clusterET);
+
+void selectClustersInRegions(Cluster (*regionClusters)[NTowersPer3x4Region], size_t nRegions, LaneIsa isa);
+
+// With bestLaneIsa()
+void selectClustersInRegions(Cluster (*regionClusters)[NTowersPer3x4Region], size_t nRegions);
+
+#endif
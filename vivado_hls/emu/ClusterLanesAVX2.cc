@@ -0,0 +1,41 @@
+#include <immintrin.h>
+
+#include "ClusterLanesKernel.hh"
+
+// Built with -mavx2
+namespace {
+
+struct AVX2Ops {
+   typedef __m256i Vector;
+   typedef __m256i Mask;
+   static const int NLanes = 16;
+
+   static Vector zero() { return _mm256_setzero_si256(); }
+   static Vector set1(uint16_t x) { return _mm256_set1_epi16(x); }
+   static Vector load(const uint16_t *p) { return _mm256_load_si256((const __m256i *) p); }
+   static void store(uint16_t *p, Vector v) { _mm256_store_si256((__m256i *) p, v); }
+   static Vector add(Vector a, Vector b) { return _mm256_add_epi16(a, b); }
+   static Vector sub(Vector a, Vector b) { return _mm256_sub_epi16(a, b); }
+   template<int N> static Vector shl(Vector a) { return _mm256_slli_epi16(a, N); }
+   template<int N> static Vector shr(Vector a) { return _mm256_srli_epi16(a, N); }
+   static Vector addSat(Vector a, Vector b) { return _mm256_adds_epu16(a, b); }
+   // No unsigned compare before AVX-512: a < b where max(a, b) != a
+   static Mask less(Vector a, Vector b) {
+      return _mm256_xor_si256(_mm256_cmpeq_epi16(_mm256_max_epu16(a, b), a), _mm256_set1_epi16(-1));
+   }
+   static Mask equal(Vector a, Vector b) { return _mm256_cmpeq_epi16(a, b); }
+   static Vector min(Vector a, Vector b) { return _mm256_min_epu16(a, b); }
+   static Vector max(Vector a, Vector b) { return _mm256_max_epu16(a, b); }
+   static Vector select(Mask m, Vector a, Vector b) { return _mm256_blendv_epi8(b, a, m); }
+};
+
+}
+
+void getClustersInTowersAVX2(const uint16_t *crystals, size_t nTowers,
+      uint16_t *peakEta, uint16_t *peakPhi, uint16_t *towerET, uint16_t *clusterET) {
+   getClustersInTowerLanes<AVX2Ops>(crystals, nTowers, peakEta, peakPhi, towerET, clusterET);
+}
+
+void selectClustersInRegionsAVX2(Cluster (*regionClusters)[NTowersPer3x4Region], size_t nRegions) {
+   selectClustersInLanes<AVX2Ops>(regionClusters, nRegions);
+}
@@ -0,0 +1,38 @@
+#include <immintrin.h>
+
+#include "ClusterLanesKernel.hh"
+
+// Built with -mavx512bw
+namespace {
+
+struct AVX512Ops {
+   typedef __m512i Vector;
+   typedef __mmask32 Mask;
+   static const int NLanes = 32;
+
+   static Vector zero() { return _mm512_setzero_si512(); }
+   static Vector set1(uint16_t x) { return _mm512_set1_epi16(x); }
+   static Vector load(const uint16_t *p) { return _mm512_load_si512((const void *) p); }
+   static void store(uint16_t *p, Vector v) { _mm512_store_si512((void *) p, v); }
+   static Vector add(Vector a, Vector b) { return _mm512_add_epi16(a, b); }
+   static Vector sub(Vector a, Vector b) { return _mm512_sub_epi16(a, b); }
+   template<int N> static Vector shl(Vector a) { return _mm512_slli_epi16(a, N); }
+   template<int N> static Vector shr(Vector a) { return _mm512_srli_epi16(a, N); }
+   static Vector addSat(Vector a, Vector b) { return _mm512_adds_epu16(a, b); }
+   static Mask less(Vector a, Vector b) { return _mm512_cmplt_epu16_mask(a, b); }
+   static Mask equal(Vector a, Vector b) { return _mm512_cmpeq_epi16_mask(a, b); }
+   static Vector min(Vector a, Vector b) { return _mm512_min_epu16(a, b); }
+   static Vector max(Vector a, Vector b) { return _mm512_max_epu16(a, b); }
+   static Vector select(Mask m, Vector a, Vector b) { return _mm512_mask_blend_epi16(m, b, a); }
+};
+
+}
+
+void getClustersInTowersAVX512(const uint16_t *crystals, size_t nTowers,
+      uint16_t *peakEta, uint16_t *peakPhi, uint16_t *towerET, uint16_t *clusterET) {
+   getClustersInTowerLanes<AVX512Ops>(crystals, nTowers, peakEta, peakPhi, towerET, clusterET);
+}
+
+void selectClustersInRegionsAVX512(Cluster (*regionClusters)[NTowersPer3x4Region], size_t nRegions) {
+   selectClustersInLanes<AVX512Ops>(regionClusters, nRegions);
+}
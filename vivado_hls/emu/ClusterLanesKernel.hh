@@ -0,0 +1,184 @@
+#ifndef ClusterLanesKernel_hh
+#define ClusterLanesKernel_hh
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ClusterFinder.hh"
+#include "SortingNetwork.hh"
+
+/*
+ * Lane parallel getClustersInTower and selectClustersInRegion, included by the
+ * translation units built for one instruction set (ClusterLanesAVX2.cc,
+ * ClusterLanesAVX512.cc).
+ *
+ * Ops gives the vectors of NLanes 16 bit lanes: zero, set1, load, store, add and
+ * sub (wrapping), shl<N> and shr<N> (logical), addSat (unsigned saturating), less
+ * (mask of the lanes where a < b, unsigned), equal, min, max and select (m ? a : b).
+ *
+ * Towers: the uint16_t arithmetic of getClustersInTower wraps modulo 2^16 like the
+ * 16 bit lanes, except for the thresholds of getPeakBinOf5 (etSum << 1 etc.), which
+ * are computed in int there. iEtSum being 16 bit, iEtSum <= T is the same as
+ * iEtSum <= min(T, 0xFFFF), so the thresholds are computed with saturating adds.
+ *
+ * Selection: a Cluster is split into three fields, its 16 bit ET, tower ET and
+ * position (the low 16 bits of Cluster::data), and BitonicSelector runs as is on
+ * ClusterLanes keys through the compareExchange overload below.
+ *
+ * Everything here has internal linkage, and Cluster is only accessed through its
+ * data member: no inline function compiled with the instruction set flags of
+ * these translation units can be picked by the linker for the generic code.
+ */
+
+namespace {
+
+template<class Ops>
+struct ClusterLanes {
+   typename Ops::Vector et;
+   typename Ops::Vector towerET;
+   typename Ops::Vector position;
+
+   ClusterLanes() : et(Ops::zero()), towerET(Ops::zero()), position(Ops::zero()) {}
+};
+
+// Swaps the lanes where the entries are out of order, equal ETs are not swapped
+template<bool Descending, class Ops>
+inline void compareExchange(ClusterLanes<Ops> key[], NoPayload *, int i, int l) {
+   typedef typename Ops::Vector Vector;
+   Vector etI = key[i].et;
+   Vector etL = key[l].et;
+   typename Ops::Mask swap = Descending ? Ops::less(etI, etL) : Ops::less(etL, etI);
+   key[i].et = Descending ? Ops::max(etI, etL) : Ops::min(etI, etL);
+   key[l].et = Descending ? Ops::min(etI, etL) : Ops::max(etI, etL);
+
+   Vector towerETI = key[i].towerET;
+   key[i].towerET = Ops::select(swap, key[l].towerET, towerETI);
+   key[l].towerET = Ops::select(swap, towerETI, key[l].towerET);
+   Vector positionI = key[i].position;
+   key[i].position = Ops::select(swap, key[l].position, positionI);
+   key[l].position = Ops::select(swap, positionI, key[l].position);
+}
+
+// getPeakBinOf5 of the strips against etSum
+template<class Ops>
+inline typename Ops::Vector peakBinOf5(const typename Ops::Vector strip[NCrystalsPerEtaPhi], typename Ops::Vector etSum) {
+   typedef typename Ops::Vector Vector;
+   Vector iEtSum = Ops::template shr<1>(strip[0]);
+   iEtSum = Ops::add(iEtSum, Ops::add(Ops::template shr<1>(strip[1]), strip[1]));
+   iEtSum = Ops::add(iEtSum, Ops::add(Ops::template shr<1>(strip[2]), Ops::template shl<1>(strip[2])));
+   iEtSum = Ops::add(iEtSum, Ops::sub(Ops::template shl<2>(strip[3]), Ops::template shr<1>(strip[3])));
+   iEtSum = Ops::add(iEtSum, Ops::add(Ops::template shl<2>(strip[4]), Ops::template shr<1>(strip[4])));
+
+   Vector twice = Ops::addSat(etSum, etSum);
+   Vector threshold[4] = { etSum, twice, Ops::addSat(twice, etSum), Ops::addSat(twice, twice) };
+   // The thresholds increase: the last one exceeded gives the bin
+   Vector bin = Ops::zero();
+   for(int i = 0; i < 4; i++)
+      bin = Ops::select(Ops::less(threshold[i], iEtSum), Ops::set1(i + 1), bin);
+   return bin;
+}
+
+template<class Ops>
+void getClustersInTowerLanes(const uint16_t *crystals, size_t nTowers,
+      uint16_t *peakEta, uint16_t *peakPhi, uint16_t *towerET, uint16_t *clusterET) {
+   typedef typename Ops::Vector Vector;
+   const int NLanes = Ops::NLanes;
+   const int NCrystals = NCrystalsPerEtaPhi * NCrystalsPerEtaPhi;
+   alignas(64) uint16_t crystal[NCrystals][NLanes];
+   alignas(64) uint16_t out[4][NLanes];
+
+   for(size_t first = 0; first < nTowers; first += NLanes) {
+      size_t n = nTowers - first < (size_t) NLanes ? nTowers - first : NLanes;
+      // Unused lanes get empty towers
+      for(int lane = 0; lane < NLanes; lane++) {
+	 const uint16_t *tower = (size_t) lane < n ? &crystals[(first + lane) * NCrystals] : 0;
+	 for(int c = 0; c < NCrystals; c++)
+	    crystal[c][lane] = tower ? tower[c] : 0;
+      }
+
+      Vector phiStripSum[NCrystalsPerEtaPhi];
+      Vector etaStripSum[NCrystalsPerEtaPhi];
+      for(int i = 0; i < NCrystalsPerEtaPhi; i++)
+	 phiStripSum[i] = etaStripSum[i] = Ops::zero();
+      for(int eta = 0; eta < NCrystalsPerEtaPhi; eta++) {
+	 for(int phi = 0; phi < NCrystalsPerEtaPhi; phi++) {
+	    Vector et = Ops::load(crystal[eta * NCrystalsPerEtaPhi + phi]);
+	    phiStripSum[phi] = Ops::add(phiStripSum[phi], et);
+	    etaStripSum[eta] = Ops::add(etaStripSum[eta], et);
+	 }
+      }
+      Vector tower = Ops::zero();
+      for(int phi = 0; phi < NCrystalsPerEtaPhi; phi++)
+	 tower = Ops::add(tower, phiStripSum[phi]);
+
+      Vector peakEtaBin = peakBinOf5<Ops>(etaStripSum, tower);
+      Vector peakPhiBin = peakBinOf5<Ops>(phiStripSum, tower);
+
+      // 3 eta strips around the peak, 2 at the edges
+      Vector cluster = Ops::add(etaStripSum[0], etaStripSum[1]);
+      for(int peak = 1; peak < NCrystalsPerEtaPhi; peak++) {
+	 Vector window = Ops::add(etaStripSum[peak - 1], etaStripSum[peak]);
+	 if(peak + 1 < NCrystalsPerEtaPhi)
+	    window = Ops::add(window, etaStripSum[peak + 1]);
+	 cluster = Ops::select(Ops::equal(peakEtaBin, Ops::set1(peak)), window, cluster);
+      }
+
+      Ops::store(out[0], peakEtaBin);
+      Ops::store(out[1], peakPhiBin);
+      Ops::store(out[2], tower);
+      Ops::store(out[3], cluster);
+      for(size_t lane = 0; lane < n; lane++) {
+	 peakEta[first + lane] = out[0][lane];
+	 peakPhi[first + lane] = out[1][lane];
+	 towerET[first + lane] = out[2][lane];
+	 clusterET[first + lane] = out[3][lane];
+      }
+   }
+}
+
+template<class Ops>
+void selectClustersInLanes(Cluster (*regionClusters)[NTowersPer3x4Region], size_t nRegions) {
+   const int NLanes = Ops::NLanes;
+   alignas(64) uint16_t et[NTowersPer3x4Region][NLanes];
+   alignas(64) uint16_t towerET[NTowersPer3x4Region][NLanes];
+   alignas(64) uint16_t position[NTowersPer3x4Region][NLanes];
+   ClusterLanes<Ops> key[NTowersPer3x4Region];
+
+   for(size_t first = 0; first < nRegions; first += NLanes) {
+      size_t n = nRegions - first < (size_t) NLanes ? nRegions - first : NLanes;
+      // Unused lanes sort empty clusters
+      for(int i = 0; i < NTowersPer3x4Region; i++) {
+	 for(int lane = 0; lane < NLanes; lane++) {
+	    uint64_t data = (size_t) lane < n ? regionClusters[first + lane][i].data : 0;
+	    et[i][lane] = data >> 32;
+	    towerET[i][lane] = data >> 16;
+	    position[i][lane] = data;
+	 }
+	 key[i].et = Ops::load(et[i]);
+	 key[i].towerET = Ops::load(towerET[i]);
+	 key[i].position = Ops::load(position[i]);
+      }
+
+      BitonicSelector<NTowersPer3x4Region, NClustersPer3x4Region>::select(key);
+
+      for(int i = 0; i < NClustersPer3x4Region; i++) {
+	 Ops::store(et[i], key[i].et);
+	 Ops::store(towerET[i], key[i].towerET);
+	 Ops::store(position[i], key[i].position);
+	 for(size_t lane = 0; lane < n; lane++)
+	    regionClusters[first + lane][i].data =
+	       ((uint64_t) et[i][lane] << 32) | ((uint64_t) towerET[i][lane] << 16) | position[i][lane];
+      }
+   }
+}
+
+}
+
+void getClustersInTowersAVX2(const uint16_t *crystals, size_t nTowers,
+      uint16_t *peakEta, uint16_t *peakPhi, uint16_t *towerET, uint16_t *clusterET);
+void getClustersInTowersAVX512(const uint16_t *crystals, size_t nTowers,
+      uint16_t *peakEta, uint16_t *peakPhi, uint16_t *towerET, uint16_t *clusterET);
+void selectClustersInRegionsAVX2(Cluster (*regionClusters)[NTowersPer3x4Region], size_t nRegions);
+void selectClustersInRegionsAVX512(Cluster (*regionClusters)[NTowersPer3x4Region], size_t nRegions);
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef CrystalSums_hh
+#define CrystalSums_hh
+
+#include <stdint.h>
+
+#include "ClusterFinder.hh"
+
+/*
+ * Summed-area table of the crystal grid of a card, for constant time sums of any
+ * rectangular window of crystals. Emulator only: the HLS code keeps the per-tower
+ * adder trees of getClustersInTower.
+ *
+ * The grid has crystal eta = tEta * 5 + cEta (NEta = 5 * Card::NTowersInEta rows)
+ * and crystal phi = tPhi * 5 + cPhi (NPhi = 20 columns), sum[eta][phi] being the sum
+ * of the crystals below eta and phi. window(eta, phi, nEta, nPhi) sums the nEta x nPhi
+ * crystals starting at (eta, phi) with four lookups.
+ *
+ * Sums wrap modulo 2^bits of Sum, and so do the window differences: they are exact
+ * modulo 2^bits. With uint16_t they are the uint16_t sums of getClustersInTower, with
+ * the default uint32_t the full sums (a card has at most 8500 crystals of 16 bits).
+ */
+template<class Card, class Sum = uint32_t>
+struct CrystalSums {
+   static const int NEta = Card::NTowersInEta * NCrystalsPerEtaPhi;
+   static const int NPhi = Card::NTowersInPhi * NCrystalsPerEtaPhi;
+
+   Sum sum[NEta + 1][NPhi + 1];
+
+   void build(const uint16_t crystals[Card::NCrystals]) {
+      for(int phi = 0; phi <= NPhi; phi++)
+	 sum[0][phi] = 0;
+      for(int eta = 0; eta < NEta; eta++) {
+	 const uint16_t *row = &crystals[(eta / NCrystalsPerEtaPhi) * NCaloLayer1Phi * 25 + (eta % NCrystalsPerEtaPhi) * 5];
+	 Sum rowSum = 0;
+	 sum[eta + 1][0] = 0;
+	 for(int tPhi = 0; tPhi < NCaloLayer1Phi; tPhi++) {
+	    for(int cPhi = 0; cPhi < NCrystalsPerEtaPhi; cPhi++) {
+	       int phi = tPhi * NCrystalsPerEtaPhi + cPhi;
+	       rowSum += row[tPhi * 25 + cPhi];
+	       sum[eta + 1][phi + 1] = sum[eta][phi + 1] + rowSum;
+	    }
+	 }
+      }
+   }
+
+   Sum window(int eta, int phi, int nEta, int nPhi) const {
+      return sum[eta + nEta][phi + nPhi] - sum[eta][phi + nPhi] - sum[eta + nEta][phi] + sum[eta][phi];
+   }
+};
+
+// getClustersInTower of the tower (tEta, tPhi) of the card, from the window sums
+template<class Card, class Sum>
+void getClustersInTower(const CrystalSums<Card, Sum> &sums, int tEta, int tPhi,
+      uint16_t *peakEta,
+      uint16_t *peakPhi,
+      uint16_t *towerET,
+      uint16_t *clusterET) {
+   int eta = tEta * NCrystalsPerEtaPhi;
+   int phi = tPhi * NCrystalsPerEtaPhi;
+
+   uint16_t etaStripSum[NCrystalsPerEtaPhi];
+   uint16_t phiStripSum[NCrystalsPerEtaPhi];
+   for(int i = 0; i < NCrystalsPerEtaPhi; i++) {
+      etaStripSum[i] = sums.window(eta + i, phi, 1, NCrystalsPerEtaPhi);
+      phiStripSum[i] = sums.window(eta, phi + i, NCrystalsPerEtaPhi, 1);
+   }
+   *towerET = sums.window(eta, phi, NCrystalsPerEtaPhi, NCrystalsPerEtaPhi);
+
+   *peakEta = getPeakBinOf5(etaStripSum, *towerET);
+   *peakPhi = getPeakBinOf5(phiStripSum, *towerET);
+
+   // Small cluster ET is just the 3x5 around the peak
+   int first = *peakEta > 0 ? *peakEta - 1 : 0;
+   int last = *peakEta < NCrystalsPerEtaPhi - 1 ? *peakEta + 1 : NCrystalsPerEtaPhi - 1;
+   *clusterET = sums.window(eta + first, phi, last - first + 1, NCrystalsPerEtaPhi);
+}
+
+// getMergedClustersInCard<Card> with the tower sums of all towers from the table
+// of the card instead of the adder trees of each tower: the tower stage of the
+// full-barrel DetectorEmulator (checked by rct_emu --check-cards)
+template<class Card>
+bool getMergedClustersInCardFromSums(const uint16_t crystals[Card::NCrystals],
+      Cluster regionClusters[Card::NRegions][NTowersPer3x4Region]) {
+   uint16_t peakEta[Card::NTowersInEta][NCaloLayer1Phi];
+   uint16_t peakPhi[Card::NTowersInEta][NCaloLayer1Phi];
+   uint16_t towerET[Card::NTowersInEta][NCaloLayer1Phi];
+   uint16_t clusterET[Card::NTowersInEta][NCaloLayer1Phi];
+   CrystalSums<Card, uint16_t> sums;
+   sums.build(crystals);
+   for(int tEta = 0; tEta < Card::NTowersInEta; tEta++) {
+      for(int tPhi = 0; tPhi < NCaloLayer1Phi; tPhi++) {
+	 getClustersInTower(sums, tEta, tPhi,
+	       &peakEta[tEta][tPhi], &peakPhi[tEta][tPhi], &towerET[tEta][tPhi], &clusterET[tEta][tPhi]);
+      }
+   }
+   return mergeTowerClustersInCard<Card>(peakEta, peakPhi, towerET, clusterET, regionClusters);
+}
+
+#endif
@@ -0,0 +1,117 @@
+#include <stdio.h>
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "Detector.hh"
+#include "LinkFormat.hh"
+#include "CrystalSums.hh"
+
+using namespace std;
+
+static const uint32_t UnmappedLink = 0xFFFFFFFF;
+
+LinkMap::LinkMap() : links_(NRCTCards * N_CH_IN) {
+   for (uint32_t i = 0; i < links_.size(); i++) links_[i] = i;
+}
+
+bool LinkMap::load(const string &name) {
+   if (name == "identity") {
+      for (uint32_t i = 0; i < links_.size(); i++) links_[i] = i;
+      return true;
+   }
+   if (name == "replicate") {
+      for (uint32_t i = 0; i < links_.size(); i++) links_[i] = i % N_CH_IN;
+      return true;
+   }
+
+   ifstream ifs(name.c_str());
+   if (!ifs.is_open()) {
+      cerr << "Error opening link map: " << name << endl;
+      return false;
+   }
+   links_.assign(NRCTCards * N_CH_IN, UnmappedLink);
+   string line;
+   int lineNumber = 0;
+   while (getline(ifs, line)) {
+      lineNumber++;
+      size_t comment = line.find('#');
+      if (comment != string::npos) line.erase(comment);
+      istringstream iss(line);
+      long card, cardLink, detectorLink;
+      if (!(iss >> card)) continue;
+      if (!(iss >> cardLink >> detectorLink) || card < 0 || card >= NRCTCards ||
+	    cardLink < 0 || cardLink >= N_CH_IN || detectorLink < 0) {
+	 cerr << name << ":" << lineNumber << ": expected \"card(0-" << NRCTCards - 1 << ") cardLink(0-"
+	      << N_CH_IN - 1 << ") detectorLink\"" << endl;
+	 return false;
+      }
+      links_[card * N_CH_IN + cardLink] = detectorLink;
+   }
+   for (uint32_t i = 0; i < links_.size(); i++) {
+      if (links_[i] == UnmappedLink) {
+	 cerr << name << ": card " << i / N_CH_IN << " link " << i % N_CH_IN << " is not mapped" << endl;
+	 return false;
+      }
+   }
+   return true;
+}
+
+uint32_t LinkMap::nDetectorLinks() const {
+   uint32_t n = 0;
+   for (uint32_t i = 0; i < links_.size(); i++)
+      if (links_[i] + 1 > n) n = links_[i] + 1;
+   return n;
+}
+
+DetectorEmulator::DetectorEmulator(const LinkMap &map, ThreadPool &pool) : map_(map), pool_(pool) {
+}
+
+bool DetectorEmulator::processEvent(ap_uint<192> *detector_in, ClusterColumns &clusters, ap_uint<192> *cards_out) {
+   clusters.reset(NRCTCards);
+   atomic<bool> success(true);
+   pool_.parallelFor(NRCTCards, 1, [&](size_t begin, size_t end) {
+      for (size_t card = begin; card < end; card++) {
+	 ap_uint<192> link_in[N_CH_IN];
+	 for (int link = 0; link < N_CH_IN; link++)
+	    link_in[link] = detector_in[map_.link(card, link)];
+
+	 uint16_t crystals[NCrystalsPerCard];
+	 unpackCrystals(link_in, crystals, false);
+
+	 size_t first = card * NClustersPerCard;
+	 // Most cards of an event are empty
+	 TowerOccupancy occupancy;
+	 getTowerOccupancy(crystals, 0, occupancy);
+	 // Otherwise getClustersInCard in the emulator's steps: the towers from the
+	 // summed-area table of the card, the sequential merge of the regions
+	 Cluster regionClusters[RCTCard::NRegions][NTowersPer3x4Region];
+	 if (occupancy.empty())
+	    setEmptyCardClusters(clusters, card);
+	 else if (!getMergedClustersInCardFromSums<RCTCard>(crystals, regionClusters))
+	    success = false;
+	 else {
+	    for (int iRegion = 0; iRegion < RCTCard::NRegions; iRegion++)
+	       selectClustersInRegion(regionClusters[iRegion]);
+	    mergeClustersInCardSequential<RCTCard>(regionClusters,
+		  &clusters.peakEta[first],
+		  &clusters.peakPhi[first],
+		  &clusters.towerEta[first],
+		  &clusters.towerPhi[first],
+		  &clusters.towerET[first],
+		  &clusters.ET[first]);
+	 }
+
+	 packClusters(&clusters.peakEta[first],
+	       &clusters.peakPhi[first],
+	       &clusters.towerEta[first],
+	       &clusters.towerPhi[first],
+	       &clusters.ET[first],
+	       &cards_out[card * N_CH_OUT],
+	       false);
+      }
+   });
+   return success;
+}
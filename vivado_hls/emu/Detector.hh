@@ -0,0 +1,59 @@
+#ifndef Detector_hh
+#define Detector_hh
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "algo_unpacked.h"
+#include "ClusterFinder.hh"
+#include "EventBatch.hh"
+#include "ThreadPool.hh"
+
+// Barrel e/gamma RCT: 18 cards in phi for each half of the barrel
+const uint16_t NRCTCards = 2 * NCaloLayer1Cards;
+
+/*
+ * Routes detector input links to the N_CH_IN input links of every RCT card.
+ *
+ * Map files hold one "card cardLink detectorLink" triplet per line ('#' starts
+ * a comment) and must cover every input of every card. Two maps are built in:
+ * "identity" (card c reads detector links c * N_CH_IN ... c * N_CH_IN + 47) and
+ * "replicate" (every card reads detector links 0-47, to fan one card's test
+ * vector out to the whole barrel).
+ */
+class LinkMap {
+public:
+   LinkMap();
+
+   // name is "identity", "replicate" or a map file; false (with a message) on error
+   bool load(const std::string &name);
+
+   uint32_t link(uint16_t card, uint16_t cardLink) const { return links_[card * N_CH_IN + cardLink]; }
+   // Number of detector links an input frame needs for this map
+   uint32_t nDetectorLinks() const;
+
+private:
+   std::vector<uint32_t> links_;  // [card * N_CH_IN + cardLink]
+};
+
+/*
+ * Full-barrel emulation: every event is run through all NRCTCards card
+ * instances, which are processed concurrently on the thread pool. Each card
+ * gets the tower sums of its towers from its summed-area table (CrystalSums.hh).
+ */
+class DetectorEmulator {
+public:
+   DetectorEmulator(const LinkMap &map, ThreadPool &pool);
+
+   // detector_in[detectorLink] -> clusters (row = card) and
+   // cards_out[card * N_CH_OUT + link]; false if any card failed
+   bool processEvent(ap_uint<192> *detector_in, ClusterColumns &clusters, ap_uint<192> *cards_out);
+
+private:
+   const LinkMap &map_;
+   ThreadPool &pool_;
+};
+
+#endif
@@ -0,0 +1,326 @@
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include "EventBatch.hh"
+#include "ClusterLanes.hh"
+#include "LinkFormat.hh"
+
+void ClusterColumns::reset(size_t n) {
+   nEvents = n;
+   peakEta.assign(n * NClustersPerCard, 0);
+   peakPhi.assign(n * NClustersPerCard, 0);
+   towerEta.assign(n * NClustersPerCard, 0);
+   towerPhi.assign(n * NClustersPerCard, 0);
+   towerET.assign(n * NClustersPerCard, 0);
+   ET.assign(n * NClustersPerCard, 0);
+}
+
+#ifndef RCT_EMU_AP_INT
+namespace {
+
+// The crystals of one input link: crystals[first, first + n) are the 16 bit fields
+// starting at byte offset byte of the link word
+struct CrystalRun {
+   int link;
+   int first;
+   int n;
+   int byte;
+};
+
+// Same link and bit map as unpackCrystals, one run per link
+constexpr std::array<CrystalRun, NCrystalLinks> crystalRuns() {
+   std::array<CrystalRun, NCrystalLinks> runs{};
+   for (int link = 0; link < NCrystalLinks; link++) {
+      int first = link * NCrystalsPerLink;
+      int n = NCrystalsPerCard - first < NCrystalsPerLink ? NCrystalsPerCard - first : NCrystalsPerLink;
+      runs[link] = CrystalRun{link, first, n, 16 / 8};
+   }
+   return runs;
+}
+
+constexpr std::array<CrystalRun, NCrystalLinks> CrystalRuns = crystalRuns();
+static_assert(CrystalRuns[NCrystalLinks - 1].first + CrystalRuns[NCrystalLinks - 1].n == NCrystalsPerCard,
+      "crystal runs must cover the card");
+static_assert(CrystalRuns[0].byte + 2 * NCrystalsPerLink <= 192 / 8, "crystal runs must fit in the link word");
+static_assert(CrystalRuns[NCrystalLinks - 2].n == NCrystalsPerLink, "only the last link may be partly filled");
+
+}
+#endif
+
+const int TowerOccupancy::NTowers;
+const int TowerOccupancy::NWords;
+
+int TowerOccupancy::count() const {
+   int n = 0;
+   for (int w = 0; w < NWords; w++)
+      n += __builtin_popcountll(bits[w]);
+   return n;
+}
+
+bool TowerOccupancy::regionOccupied(int iRegion) const {
+   int first = iRegion * NTowersPer3x4Region;
+   int last = std::min(first + NTowersPer3x4Region, NTowers);
+   for (int w = first / 64; w <= (last - 1) / 64; w++) {
+      int lo = std::max(first - w * 64, 0);
+      int hi = std::min(last - w * 64, 64);
+      uint64_t mask = (hi - lo == 64 ? ~uint64_t(0) : ((uint64_t(1) << (hi - lo)) - 1)) << lo;
+      if (bits[w] & mask)
+	 return true;
+   }
+   return false;
+}
+
+void getTowerOccupancy(const uint16_t crystals[NCrystalsPerCard], uint16_t noiseThreshold, TowerOccupancy &occupancy) {
+   const int NCrystalsPerTower = NCrystalsPerEtaPhi * NCrystalsPerEtaPhi;
+   static_assert(NCrystalsPerTower % 4 == 1, "the last crystal of a tower is or'ed on its own");
+   for (int w = 0; w < TowerOccupancy::NWords; w++)
+      occupancy.bits[w] = 0;
+   for (int tower = 0; tower < TowerOccupancy::NTowers; tower++) {
+      const uint16_t *c = &crystals[tower * NCrystalsPerTower];
+      bool occupied;
+      if (noiseThreshold == 0) {
+	 // Or of the crystals, four at a time
+	 uint64_t any = c[NCrystalsPerTower - 1];
+	 for (int i = 0; i + 4 <= NCrystalsPerTower; i += 4) {
+	    uint64_t four;
+	    memcpy(&four, &c[i], sizeof(four));
+	    any |= four;
+	 }
+	 occupied = any != 0;
+      }
+      else {
+	 uint16_t max = 0;
+	 for (int i = 0; i < NCrystalsPerTower; i++)
+	    max = std::max(max, c[i]);
+	 occupied = max > noiseThreshold;
+      }
+      occupancy.bits[tower / 64] |= uint64_t(occupied) << (tower % 64);
+   }
+}
+
+namespace {
+
+typedef Cluster RegionClusters[RCTCard::NRegions][NTowersPer3x4Region];
+
+// The steps of getClustersInCards on a card without any crystal
+struct EmptyCard {
+   RegionClusters selected;  // after selectClustersInRegion
+   ClusterColumns clusters;
+
+   EmptyCard() {
+      typedef uint16_t CardTowers[RCTCard::NTowersInEta][NCaloLayer1Phi];
+      CardTowers peakEta = {}, peakPhi = {}, towerET = {}, clusterET = {};
+      uint16_t crystals[NCrystalsPerCard] = {};
+      getClustersInTowers(crystals, RCTCard::NTowersInEta * NCaloLayer1Phi,
+	    &peakEta[0][0], &peakPhi[0][0], &towerET[0][0], &clusterET[0][0]);
+      mergeTowerClustersInCard<RCTCard>(peakEta, peakPhi, towerET, clusterET, selected);
+      selectClustersInRegions(selected, RCTCard::NRegions);
+      clusters.reset(1);
+      mergeClustersInCard<RCTCard>(selected, &clusters.peakEta[0], &clusters.peakPhi[0], &clusters.towerEta[0],
+	    &clusters.towerPhi[0], &clusters.towerET[0], &clusters.ET[0]);
+   }
+};
+
+const EmptyCard &emptyCard() {
+   static const EmptyCard card;
+   return card;
+}
+
+}
+
+void setEmptyCardClusters(ClusterColumns &clusters, size_t row) {
+   const ClusterColumns &empty = emptyCard().clusters;
+   std::vector<uint16_t> ClusterColumns::*fields[] = { &ClusterColumns::peakEta, &ClusterColumns::peakPhi,
+      &ClusterColumns::towerEta, &ClusterColumns::towerPhi, &ClusterColumns::towerET, &ClusterColumns::ET };
+   for (auto field : fields)
+      std::copy_n((empty.*field).begin(), RCTCard::NClusters, (clusters.*field).begin() + row * NClustersPerCard);
+}
+
+void unpackEvents(ap_uint<192> *link_in, size_t nEvents, uint16_t *crystals,
+      TowerOccupancy *occupancy, uint16_t noiseThreshold) {
+#ifndef RCT_EMU_AP_INT
+   // The 16 bit fields of a full link are fields 1-3 of its first word and all of
+   // the other two: three overlapping 64 bit stores (the first one writes a zero
+   // field that the second overwrites)
+   static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "the crystal runs assume little endian link words");
+   static_assert(CrystalRuns[0].byte == 2 && NCrystalsPerLink == 11, "full links are fields 1-11 of the link word");
+   constexpr CrystalRun Last = CrystalRuns[NCrystalLinks - 1];
+#endif
+   for (size_t event = 0; event < nEvents; event++) {
+      uint16_t *card = &crystals[event * NCrystalsPerCard];
+#ifdef RCT_EMU_AP_INT
+      unpackCrystals(&link_in[event * N_CH_IN], card, false);
+#else
+      const ap_uint<192> *links = &link_in[event * N_CH_IN];
+      for (int i = 0; i < NCrystalLinks - 1; i++) {
+	 const ap_uint<192> &link = links[CrystalRuns[i].link];
+	 uint16_t *run = &card[CrystalRuns[i].first];
+	 uint64_t fields[3] = { link.word(0) >> 16, link.word(1), link.word(2) };
+	 memcpy(run, &fields[0], 8);
+	 memcpy(run + 3, &fields[1], 8);
+	 memcpy(run + 7, &fields[2], 8);
+      }
+      uint64_t words[3] = { links[Last.link].word(0), links[Last.link].word(1), links[Last.link].word(2) };
+      memcpy(&card[Last.first], (const char *) words + Last.byte, 2 * Last.n);
+#endif
+      if (occupancy)
+	 getTowerOccupancy(card, noiseThreshold, occupancy[event]);
+   }
+}
+
+bool getClustersInCards(const uint16_t *crystals, size_t nEvents, ClusterColumns &clusters,
+      const TowerOccupancy *occupancy) {
+   clusters.reset(nEvents);
+   bool success = true;
+   // The tower clustering and the region selections of the whole batch run
+   // together, around the merging steps of getClustersInCard
+   const size_t NTowers = RCTCard::NTowersInEta * NCaloLayer1Phi;
+   const size_t NCrystalsPerTower = NCrystalsPerEtaPhi * NCrystalsPerEtaPhi;
+   typedef uint16_t CardTowers[RCTCard::NTowersInEta][NCaloLayer1Phi];
+   thread_local std::vector<uint16_t> peakEta, peakPhi, towerET, clusterET;
+   thread_local std::vector<Cluster> buffer;
+   thread_local std::vector<char> merged;
+   peakEta.resize(nEvents * NTowers);
+   peakPhi.resize(nEvents * NTowers);
+   towerET.resize(nEvents * NTowers);
+   clusterET.resize(nEvents * NTowers);
+   buffer.resize(nEvents * RCTCard::NRegions * NTowersPer3x4Region);
+   merged.resize(nEvents);
+
+   // Occupied towers and regions of the batch. Their lists are only used (and
+   // filled) when at most half of them are occupied: beyond that, gathering them
+   // costs more than running the lanes on the empty ones as well
+   thread_local std::vector<uint32_t> towers, regions;
+   towers.clear();
+   regions.clear();
+   bool sparseTowers = false, sparseRegions = false;
+   if (occupancy) {
+      size_t nOccupiedTowers = 0, nOccupiedRegions = 0;
+      for (size_t event = 0; event < nEvents; event++) {
+	 nOccupiedTowers += occupancy[event].count();
+	 for (int iRegion = 0; iRegion < RCTCard::NRegions; iRegion++)
+	    nOccupiedRegions += occupancy[event].regionOccupied(iRegion);
+      }
+      sparseTowers = 2 * nOccupiedTowers <= nEvents * NTowers;
+      sparseRegions = 2 * nOccupiedRegions <= nEvents * RCTCard::NRegions;
+      for (size_t event = 0; event < nEvents && sparseTowers; event++) {
+	 for (int w = 0; w < TowerOccupancy::NWords; w++) {
+	    for (uint64_t bits = occupancy[event].bits[w]; bits != 0; bits &= bits - 1)
+	       towers.push_back(event * NTowers + w * 64 + __builtin_ctzll(bits));
+	 }
+      }
+      for (size_t event = 0; event < nEvents && sparseRegions; event++) {
+	 for (int iRegion = 0; iRegion < RCTCard::NRegions; iRegion++)
+	    if (occupancy[event].regionOccupied(iRegion))
+	       regions.push_back(event * RCTCard::NRegions + iRegion);
+      }
+   }
+
+   if (!sparseTowers) {
+      getClustersInTowers(crystals, nEvents * NTowers, &peakEta[0], &peakPhi[0], &towerET[0], &clusterET[0]);
+      // The towers left out by the occupancy (below a noise threshold) get the
+      // empty tower result, as in the sparse path
+      for (size_t event = 0; event < nEvents && occupancy; event++) {
+	 for (size_t tower = 0; tower < NTowers; tower++) {
+	    if (!occupancy[event].occupied(tower)) {
+	       size_t i = event * NTowers + tower;
+	       peakEta[i] = peakPhi[i] = towerET[i] = clusterET[i] = 0;
+	    }
+	 }
+      }
+   }
+   else {
+      // Empty towers give 0 for all four; the occupied ones are gathered for the lanes
+      thread_local std::vector<uint16_t> towerCrystals, results;
+      size_t n = towers.size();
+      towerCrystals.resize(n * NCrystalsPerTower);
+      results.resize(4 * n);
+      for (size_t i = 0; i < n; i++)
+	 std::copy_n(&crystals[towers[i] * NCrystalsPerTower], NCrystalsPerTower, &towerCrystals[i * NCrystalsPerTower]);
+      if (n > 0)
+	 getClustersInTowers(&towerCrystals[0], n, &results[0], &results[n], &results[2 * n], &results[3 * n]);
+      std::fill(peakEta.begin(), peakEta.end(), 0);
+      std::fill(peakPhi.begin(), peakPhi.end(), 0);
+      std::fill(towerET.begin(), towerET.end(), 0);
+      std::fill(clusterET.begin(), clusterET.end(), 0);
+      for (size_t i = 0; i < n; i++) {
+	 peakEta[towers[i]] = results[i];
+	 peakPhi[towers[i]] = results[n + i];
+	 towerET[towers[i]] = results[2 * n + i];
+	 clusterET[towers[i]] = results[3 * n + i];
+      }
+   }
+
+   const EmptyCard &empty = emptyCard();
+   RegionClusters *regionClusters = reinterpret_cast<RegionClusters *>(buffer.data());
+   for (size_t event = 0; event < nEvents; event++) {
+      merged[event] = true;
+      if (occupancy && occupancy[event].empty())
+	 continue;
+      size_t first = event * NTowers;
+      merged[event] = mergeTowerClustersInCard<RCTCard>(
+	    reinterpret_cast<CardTowers &>(peakEta[first]),
+	    reinterpret_cast<CardTowers &>(peakPhi[first]),
+	    reinterpret_cast<CardTowers &>(towerET[first]),
+	    reinterpret_cast<CardTowers &>(clusterET[first]),
+	    regionClusters[event]);
+      success &= merged[event];
+   }
+
+   Cluster (*region)[NTowersPer3x4Region] = regionClusters[0];
+   if (!sparseRegions) {
+      // Empty cards were not merged, their regions are selected and then ignored
+      selectClustersInRegions(region, nEvents * RCTCard::NRegions);
+   }
+   else {
+      // Empty regions get the selection of the empty card, the occupied ones are
+      // gathered for the lanes
+      thread_local std::vector<Cluster> gathered;
+      size_t n = regions.size();
+      gathered.resize(n * NTowersPer3x4Region);
+      Cluster (*occupied)[NTowersPer3x4Region] = reinterpret_cast<Cluster (*)[NTowersPer3x4Region]>(gathered.data());
+      for (size_t i = 0; i < n; i++)
+	 std::copy_n(region[regions[i]], NTowersPer3x4Region, occupied[i]);
+      if (n > 0)
+	 selectClustersInRegions(occupied, n);
+      for (size_t event = 0; event < nEvents; event++)
+	 std::copy_n(&empty.selected[0][0], RCTCard::NRegions * NTowersPer3x4Region, regionClusters[event][0]);
+      for (size_t i = 0; i < n; i++)
+	 std::copy_n(occupied[i], NTowersPer3x4Region, region[regions[i]]);
+   }
+
+   // Failed cards keep their zeroed clusters
+   for (size_t event = 0; event < nEvents; event++) {
+      if (!merged[event])
+	 continue;
+      if (occupancy && occupancy[event].empty()) {
+	 setEmptyCardClusters(clusters, event);
+	 continue;
+      }
+      size_t first = event * NClustersPerCard;
+      mergeClustersInCardSequential<RCTCard>(regionClusters[event],
+	    &clusters.peakEta[first],
+	    &clusters.peakPhi[first],
+	    &clusters.towerEta[first],
+	    &clusters.towerPhi[first],
+	    &clusters.towerET[first],
+	    &clusters.ET[first]);
+   }
+   return success;
+}
+
+void packEvents(const ClusterColumns &clusters, ap_uint<192> *link_out) {
+   for (size_t event = 0; event < clusters.nEvents; event++) {
+      size_t first = event * NClustersPerCard;
+      packClusters(&clusters.peakEta[first],
+	    &clusters.peakPhi[first],
+	    &clusters.towerEta[first],
+	    &clusters.towerPhi[first],
+	    &clusters.ET[first],
+	    &link_out[event * N_CH_OUT],
+	    false);
+   }
+}
@@ -0,0 +1,109 @@
+#ifndef EventBatch_hh
+#define EventBatch_hh
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "algo_unpacked.h"
+#include "ClusterFinder.hh"
+#include "SortingNetwork.hh"
+
+/*
+ * Multi-event entry points around getClustersInCard for the emulator.
+ *
+ * A batch of N events is held as one contiguous crystal buffer
+ * (crystals[event * NCrystalsPerCard + crystalID]) and the sorted clusters are
+ * returned in columns, one array per cluster field, so that the per-event work
+ * runs back to back without the per-call setup of algo_unpacked.
+ */
+
+// Sorted clusters of a batch: field[event * NClustersPerCard + iCluster]
+// (DetectorEmulator fills one row per card of a single event instead)
+struct ClusterColumns {
+   size_t nEvents;
+   std::vector<uint16_t> peakEta;
+   std::vector<uint16_t> peakPhi;
+   std::vector<uint16_t> towerEta;
+   std::vector<uint16_t> towerPhi;
+   std::vector<uint16_t> towerET;
+   std::vector<uint16_t> ET;
+
+   ClusterColumns() : nEvents(0) {}
+   // Resizes to n events and zeroes all clusters
+   void reset(size_t n);
+};
+
+// mergeClustersInCard<Card> with the sequential merge of the sorted region lists,
+// which gives the same output as the comparator network of the HLS code in fewer
+// compares (rct_emu --check-cards)
+template<class Card>
+void mergeClustersInCardSequential(const Cluster regionClusters[Card::NRegions][NTowersPer3x4Region],
+      uint16_t sortedCluster_peakEta[Card::NClusters],
+      uint16_t sortedCluster_peakPhi[Card::NClusters],
+      uint16_t sortedCluster_towerEta[Card::NClusters],
+      uint16_t sortedCluster_towerPhi[Card::NClusters],
+      uint16_t sortedCluster_towerET[Card::NClusters],
+      uint16_t sortedCluster_ET[Card::NClusters]) {
+   Cluster preMergeClusters[Card::NClusters];
+   Cluster sortedClusters[Card::NClusters];
+   for (int iRegion = 0; iRegion < Card::NRegions; iRegion++)
+      for (int k = 0; k < NClustersPer3x4Region; k++)
+	 preMergeClusters[iRegion * NClustersPer3x4Region + k] = regionClusters[iRegion][k];
+   SortedListMerger<Card::NRegions, NClustersPer3x4Region>::mergeSequential(preMergeClusters, sortedClusters);
+   for (int k = 0; k < Card::NClusters; k++) {
+      sortedCluster_peakEta[k] = sortedClusters[k].peakEta();
+      sortedCluster_peakPhi[k] = sortedClusters[k].peakPhi();
+      sortedCluster_towerEta[k] = sortedClusters[k].towerEta();
+      sortedCluster_towerPhi[k] = sortedClusters[k].towerPhi();
+      sortedCluster_towerET[k] = sortedClusters[k].towerET();
+      sortedCluster_ET[k] = sortedClusters[k].et();
+   }
+}
+
+// Towers of a card holding a crystal above the noise threshold, one bit per tower
+// (tower = tEta * NCaloLayer1Phi + tPhi, bit tower % 64 of bits[tower / 64])
+struct TowerOccupancy {
+   static const int NTowers = RCTCard::NTowersInEta * NCaloLayer1Phi;
+   static const int NWords = (NTowers + 63) / 64;
+   uint64_t bits[NWords];
+
+   bool occupied(int tower) const { return (bits[tower / 64] >> (tower % 64)) & 1; }
+   // Number of occupied towers
+   int count() const;
+   bool empty() const { return count() == 0; }
+   // Any occupied tower in region iRegion (towers iRegion * NTowersPer3x4Region ...)
+   bool regionOccupied(int iRegion) const;
+};
+
+// Crystals at or below noiseThreshold count as empty. With a threshold above 0 the
+// towers holding only such crystals are processed as empty towers (zero suppression,
+// which changes the output); with 0 the output is unchanged.
+void getTowerOccupancy(const uint16_t crystals[NCrystalsPerCard], uint16_t noiseThreshold, TowerOccupancy &occupancy);
+
+// Sets the clusters of row (event or card) to those of a card without any crystal,
+// what getClustersInCard gives for all zero crystals: empty regions still give
+// clusters of zero ET with their tower eta and phi
+void setEmptyCardClusters(ClusterColumns &clusters, size_t row);
+
+// link_in[event * N_CH_IN + link] -> crystals[event * NCrystalsPerCard + crystalID],
+// same as unpackCrystals but with one copy per link. If occupancy is given, also
+// fills occupancy[event] while the crystals are in cache
+void unpackEvents(ap_uint<192> *link_in, size_t nEvents, uint16_t *crystals,
+      TowerOccupancy *occupancy = 0, uint16_t noiseThreshold = 0);
+
+// Same as getClustersInCard on every event of the crystal buffer, with the towers
+// and the region selections of all events done by getClustersInTowers and
+// selectClustersInRegions; false if any card failed.
+// With occupancy[event], the empty towers, regions and cards skip the clustering:
+// they get the results of all zero crystals directly, so that the work follows the
+// number of occupied towers rather than the size of the card. The towers it leaves
+// out are empty towers whatever their crystals, however many others are occupied
+bool getClustersInCards(const uint16_t *crystals, size_t nEvents, ClusterColumns &clusters,
+      const TowerOccupancy *occupancy = 0);
+
+// clusters -> link_out[event * N_CH_OUT + link]
+void packEvents(const ClusterColumns &clusters, ap_uint<192> *link_out);
+
+#endif
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+#include "EventRunner.hh"
+#include "EventBatch.hh"
+#include "AlgoContext.hh"
+#include "IncrementalCard.hh"
+
+EventRunner::EventRunner(unsigned nThreads, bool pinThreads, size_t grain, Mode mode, uint16_t noiseThreshold,
+      FrameCache *cache)
+   : pool_(nThreads, pinThreads), grain_(grain > 0 ? grain : 1), mode_(mode), noiseThreshold_(noiseThreshold),
+   cache_(cache), nRegions_(0), nRegionsRecomputed_(0) {
+}
+
+bool EventRunner::runBatch(ap_uint<192> *link_in, size_t n, ap_uint<192> *link_out) {
+   // Scratch buffers are per thread and reused from chunk to chunk
+   thread_local std::vector<uint16_t> crystals;
+   thread_local std::vector<TowerOccupancy> occupancy;
+   thread_local ClusterColumns clusters;
+   crystals.resize(n * NCrystalsPerCard);
+   if (mode_ == Incremental) {
+      unpackEvents(link_in, n, &crystals[0]);
+      // The chunks a thread runs are not consecutive
+      thread_local IncrementalCard card;
+      card.reset();
+      uint64_t nRegions = card.nRegions(), nRecomputed = card.nRecomputed();
+      bool success = true;
+      clusters.reset(n);
+      for (size_t event = 0; event < n; event++) {
+	 size_t first = event * NClustersPerCard;
+	 success &= card.getClusters(&crystals[event * NCrystalsPerCard],
+	       &clusters.peakEta[first],
+	       &clusters.peakPhi[first],
+	       &clusters.towerEta[first],
+	       &clusters.towerPhi[first],
+	       &clusters.towerET[first],
+	       &clusters.ET[first]);
+      }
+      nRegions_ += card.nRegions() - nRegions;
+      nRegionsRecomputed_ += card.nRecomputed() - nRecomputed;
+      packEvents(clusters, link_out);
+      return success;
+   }
+   occupancy.resize(n);
+   unpackEvents(link_in, n, &crystals[0], &occupancy[0], noiseThreshold_);
+   bool success = getClustersInCards(&crystals[0], n, clusters, &occupancy[0]);
+   packEvents(clusters, link_out);
+   return success;
+}
+
+bool EventRunner::run(ap_uint<192> *link_in, size_t nEvents, ap_uint<192> *link_out, const ChunkDone &done) {
+   std::atomic<bool> success(true);
+   pool_.parallelFor(nEvents, grain_, [&](size_t begin, size_t end) {
+      if (!runChunk(link_in, begin, end, link_out)) success = false;
+      if (done) done(begin, end);
+   });
+   return success;
+}
+
+bool EventRunner::runChunk(ap_uint<192> *link_in, size_t begin, size_t end, ap_uint<192> *link_out) {
+   if (mode_ == PerEvent) {
+      AlgoContext ctx;
+      bool success = true;
+      for (size_t event = begin; event < end; event++) {
+	 if (cache_ && cache_->lookup(&link_in[event * N_CH_IN], &link_out[event * N_CH_OUT]))
+	    continue;
+	 // A failed card is not cached, as in the batched mode
+	 if (!algo_unpacked_ctx(ctx, &link_in[event * N_CH_IN], &link_out[event * N_CH_OUT]))
+	    success = false;
+	 else if (cache_)
+	    cache_->insert(&link_in[event * N_CH_IN], &link_out[event * N_CH_OUT]);
+      }
+      return success;
+   }
+   size_t n = end - begin;
+   if (!cache_)
+      return runBatch(&link_in[begin * N_CH_IN], n, &link_out[begin * N_CH_OUT]);
+
+   // Frames found in the cache are copied out. The others are gathered into a
+   // batch, each only once: repeats within the chunk are copied from the first
+   thread_local std::vector<FrameCache::Key> keys;
+   thread_local std::vector<size_t> misses, repeats, repeatOf;
+   thread_local std::unordered_map<FrameCache::Key, size_t, FrameCache::KeyHash> firstMiss;
+   thread_local std::vector<ap_uint<192> > missIn, missOut;
+   keys.resize(n);
+   misses.clear();
+   repeats.clear();
+   repeatOf.clear();
+   firstMiss.clear();
+   for (size_t event = begin; event < end; event++) {
+      FrameCache::Key &key = keys[event - begin];
+      key = FrameCache::hash(&link_in[event * N_CH_IN]);
+      if (cache_->lookup(key, &link_in[event * N_CH_IN], &link_out[event * N_CH_OUT]))
+	 continue;
+      auto first = firstMiss.find(key);
+      if (first != firstMiss.end() && std::equal(&link_in[event * N_CH_IN], &link_in[(event + 1) * N_CH_IN],
+	  &link_in[misses[first->second] * N_CH_IN])) {
+	 repeats.push_back(event);
+	 repeatOf.push_back(misses[first->second]);
+	 continue;
+      }
+      firstMiss[key] = misses.size();
+      misses.push_back(event);
+   }
+   cache_->countRepeats(repeats.size());
+   if (misses.empty())
+      return true;
+
+   bool batchSuccess;
+   if (misses.size() == n) {
+      batchSuccess = runBatch(&link_in[begin * N_CH_IN], n, &link_out[begin * N_CH_OUT]);
+   }
+   else {
+      missIn.resize(misses.size() * N_CH_IN);
+      missOut.resize(misses.size() * N_CH_OUT);
+      for (size_t i = 0; i < misses.size(); i++)
+	 std::copy_n(&link_in[misses[i] * N_CH_IN], N_CH_IN, &missIn[i * N_CH_IN]);
+      batchSuccess = runBatch(&missIn[0], misses.size(), &missOut[0]);
+      for (size_t i = 0; i < misses.size(); i++)
+	 std::copy_n(&missOut[i * N_CH_OUT], N_CH_OUT, &link_out[misses[i] * N_CH_OUT]);
+      for (size_t i = 0; i < repeats.size(); i++)
+	 std::copy_n(&link_out[repeatOf[i] * N_CH_OUT], N_CH_OUT, &link_out[repeats[i] * N_CH_OUT]);
+   }
+   // A failed card is not cached, so that its frame fails again next time
+   if (!batchSuccess)
+      return false;
+   for (size_t i = 0; i < misses.size(); i++)
+      cache_->insert(keys[misses[i] - begin], &link_in[misses[i] * N_CH_IN], &link_out[misses[i] * N_CH_OUT]);
+   return true;
+}
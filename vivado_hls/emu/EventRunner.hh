@@ -0,0 +1,64 @@
+#ifndef EventRunner_hh
+#define EventRunner_hh
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+
+#include "algo_unpacked.h"
+#include "ThreadPool.hh"
+#include "FrameCache.hh"
+
+/*
+ * Event-parallel runner: splits a block of frames into chunks of consecutive
+ * events and processes them on a work-stealing ThreadPool. Each chunk writes
+ * link_out at the same event index it read link_in from, so the results come
+ * back in the original event order whatever order the chunks ran in.
+ * With a FrameCache, the frames already seen are copied from it instead.
+ * The incremental mode only gains on chunks of many consecutive events, as each
+ * chunk starts from a full recompute of its first event.
+ */
+class EventRunner {
+public:
+   enum Mode {
+      Batched,      // unpackEvents, getClustersInCards and packEvents on each chunk
+      PerEvent,     // algo_unpacked_ctx on each event
+      Incremental   // IncrementalCard on the events of each chunk, in order
+   };
+
+   // grain: events per chunk; noiseThreshold: crystal ET at or below which the batched
+   // mode treats towers as empty; cache: if given, frames found in it are not processed
+   // again, and the processed ones are added
+   EventRunner(unsigned nThreads, bool pinThreads, size_t grain, Mode mode, uint16_t noiseThreshold = 0,
+	 FrameCache *cache = 0);
+
+   unsigned nThreads() const { return pool_.size(); }
+
+   // Incremental mode: regions seen and regions recomputed so far
+   uint64_t nRegions() const { return nRegions_; }
+   uint64_t nRegionsRecomputed() const { return nRegionsRecomputed_; }
+
+   // Called on the worker once link_out of events begin ... end - 1 is complete
+   typedef std::function<void(size_t begin, size_t end)> ChunkDone;
+
+   // link_in[event * N_CH_IN + link] -> link_out[event * N_CH_OUT + link]; false if any card failed
+   bool run(ap_uint<192> *link_in, size_t nEvents, ap_uint<192> *link_out, const ChunkDone &done = ChunkDone());
+
+private:
+   // Events begin ... end - 1, from the cache or processed
+   bool runChunk(ap_uint<192> *link_in, size_t begin, size_t end, ap_uint<192> *link_out);
+   // Batched or incremental processing of n frames
+   bool runBatch(ap_uint<192> *link_in, size_t n, ap_uint<192> *link_out);
+
+   ThreadPool pool_;
+   size_t grain_;
+   Mode mode_;
+   uint16_t noiseThreshold_;
+   FrameCache *cache_;
+   std::atomic<uint64_t> nRegions_;
+   std::atomic<uint64_t> nRegionsRecomputed_;
+};
+
+#endif
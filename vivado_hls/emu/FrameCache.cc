@@ -0,0 +1,123 @@
+#include <algorithm>
+
+#include "FrameCache.hh"
+
+namespace {
+
+uint64_t linkWord(const ap_uint<192> &link, int w) {
+#ifdef RCT_EMU_AP_INT
+   return link.range(64 * w + 63, 64 * w).to_uint64();
+#else
+   return link.word(w);
+#endif
+}
+
+uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// Final mix of MurmurHash3
+uint64_t fmix64(uint64_t k) {
+   k ^= k >> 33;
+   k *= 0xFF51AFD7ED558CCDull;
+   k ^= k >> 33;
+   k *= 0xC4CEB9FE1A85EC53ull;
+   k ^= k >> 33;
+   return k;
+}
+
+}
+
+FrameCache::FrameCache(size_t capacity, unsigned nShards)
+   : capacity_(capacity), lookups_(0), hits_(0), insertions_(0), evictions_(0), repeats_(0) {
+   if (nShards == 0) nShards = 1;
+   if (capacity < nShards) nShards = capacity > 0 ? capacity : 1;
+   shardCapacity_ = capacity / nShards;
+   for (unsigned i = 0; i < nShards; i++)
+      shards_.push_back(std::unique_ptr<Shard>(new Shard));
+}
+
+// Two MurmurHash3 x64 128 style lanes over the 64 bit words of the links
+FrameCache::Key FrameCache::hash(const ap_uint<192> link_in[N_CH_IN]) {
+   const uint64_t c1 = 0x87C37B91114253D5ull;
+   const uint64_t c2 = 0x4CF5AD432745937Full;
+   uint64_t h1 = 0x9E3779B97F4A7C15ull;
+   uint64_t h2 = 0xC2B2AE3D27D4EB4Full;
+   for (int link = 0; link < N_CH_IN; link++) {
+      for (int w = 0; w < 3; w++) {
+	 uint64_t k = linkWord(link_in[link], w);
+	 if ((link * 3 + w) % 2 == 0) {
+	    h1 ^= rotl(k * c1, 31) * c2;
+	    h1 = (rotl(h1, 27) + h2) * 5 + 0x52DCE729;
+	 }
+	 else {
+	    h2 ^= rotl(k * c2, 33) * c1;
+	    h2 = (rotl(h2, 31) + h1) * 5 + 0x38495AB5;
+	 }
+      }
+   }
+   h1 += h2;
+   h2 += h1;
+   h1 = fmix64(h1);
+   h2 = fmix64(h2);
+   h1 += h2;
+   h2 += h1;
+   Key key = { h1, h2 };
+   return key;
+}
+
+size_t FrameCache::size() const {
+   size_t n = 0;
+   for (size_t i = 0; i < shards_.size(); i++) {
+      std::lock_guard<std::mutex> lock(shards_[i]->mutex);
+      n += shards_[i]->lru.size();
+   }
+   return n;
+}
+
+FrameCache::Stats FrameCache::stats() const {
+   Stats s = { lookups_.load(), hits_.load(), insertions_.load(), evictions_.load(), repeats_.load() };
+   return s;
+}
+
+bool FrameCache::lookup(const Key &key, const ap_uint<192> link_in[N_CH_IN], ap_uint<192> link_out[N_CH_OUT]) {
+   lookups_++;
+   if (shardCapacity_ == 0)
+      return false;
+   Shard &s = shard(key);
+   std::lock_guard<std::mutex> lock(s.mutex);
+   auto it = s.index.find(key);
+   if (it == s.index.end() || !std::equal(link_in, link_in + N_CH_IN, it->second->in))
+      return false;
+   s.lru.splice(s.lru.begin(), s.lru, it->second);
+   std::copy(it->second->out, it->second->out + N_CH_OUT, link_out);
+   hits_++;
+   return true;
+}
+
+void FrameCache::insert(const Key &key, const ap_uint<192> link_in[N_CH_IN], const ap_uint<192> link_out[N_CH_OUT]) {
+   if (shardCapacity_ == 0)
+      return;
+   Shard &s = shard(key);
+   std::lock_guard<std::mutex> lock(s.mutex);
+   auto it = s.index.find(key);
+   if (it != s.index.end()) {
+      // Already there (another thread, or a colliding frame that replaces it)
+      s.lru.splice(s.lru.begin(), s.lru, it->second);
+   }
+   else {
+      if (s.lru.size() >= shardCapacity_) {
+	 // Reuse the least recently used entry
+	 s.index.erase(s.lru.back().key);
+	 s.lru.splice(s.lru.begin(), s.lru, std::prev(s.lru.end()));
+	 evictions_++;
+      }
+      else {
+	 s.lru.emplace_front();
+      }
+      s.lru.front().key = key;
+      s.index[key] = s.lru.begin();
+   }
+   Entry &e = s.lru.front();
+   std::copy(link_in, link_in + N_CH_IN, e.in);
+   std::copy(link_out, link_out + N_CH_OUT, e.out);
+   insertions_++;
+}
@@ -0,0 +1,96 @@
+#ifndef FrameCache_hh
+#define FrameCache_hh
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "algo_unpacked.h"
+
+/*
+ * Bounded memoization cache of processed frames: the N_CH_OUT output links of an
+ * input frame, found from a 128 bit hash of its N_CH_IN input links. Replay streams
+ * repeat many frames (empty crossings, calibration patterns), which then skip the
+ * unpacking, clustering and packing.
+ *
+ * Entries keep their input links and a hit compares them, so that a hash collision
+ * can only cost a miss. The cache is split in shards by hash, each with its own
+ * mutex and least recently used list holding at most capacity / nShards entries,
+ * so that the threads of the runner can share it. The counters are atomic.
+ */
+class FrameCache {
+public:
+   // 128 bit hash of an input frame
+   struct Key {
+      uint64_t lo;
+      uint64_t hi;
+      bool operator==(const Key &k) const { return lo == k.lo && hi == k.hi; }
+   };
+   struct KeyHash {
+      size_t operator()(const Key &k) const { return k.hi; }
+   };
+
+   struct Stats {
+      uint64_t lookups;
+      uint64_t hits;
+      uint64_t insertions;
+      uint64_t evictions;
+      uint64_t repeats;  // misses served from an identical frame of the same batch (see countRepeats)
+   };
+
+   explicit FrameCache(size_t capacity, unsigned nShards = 16);
+
+   size_t capacity() const { return capacity_; }
+   // Entries currently held
+   size_t size() const;
+   Stats stats() const;
+
+   static Key hash(const ap_uint<192> link_in[N_CH_IN]);
+
+   // Copies the output links of link_in to link_out if cached; false otherwise
+   bool lookup(const ap_uint<192> link_in[N_CH_IN], ap_uint<192> link_out[N_CH_OUT]) {
+      return lookup(hash(link_in), link_in, link_out);
+   }
+   // Caches link_out as the output of link_in, evicting the least recently used
+   // entry of its shard if full
+   void insert(const ap_uint<192> link_in[N_CH_IN], const ap_uint<192> link_out[N_CH_OUT]) {
+      insert(hash(link_in), link_in, link_out);
+   }
+   // Counts n misses that were served without processing, from an identical frame
+   // processed along with them
+   void countRepeats(uint64_t n) { repeats_ += n; }
+   // Same with the hash of link_in already computed
+   bool lookup(const Key &key, const ap_uint<192> link_in[N_CH_IN], ap_uint<192> link_out[N_CH_OUT]);
+   void insert(const Key &key, const ap_uint<192> link_in[N_CH_IN], const ap_uint<192> link_out[N_CH_OUT]);
+
+private:
+   struct Entry {
+      Key key;
+      ap_uint<192> in[N_CH_IN];
+      ap_uint<192> out[N_CH_OUT];
+   };
+   struct Shard {
+      std::mutex mutex;
+      std::list<Entry> lru;  // most recently used first
+      std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+   };
+
+   Shard &shard(const Key &key) { return *shards_[key.lo % shards_.size()]; }
+
+   size_t capacity_;
+   size_t shardCapacity_;
+   std::vector<std::unique_ptr<Shard> > shards_;
+   std::atomic<uint64_t> lookups_;
+   std::atomic<uint64_t> hits_;
+   std::atomic<uint64_t> insertions_;
+   std::atomic<uint64_t> evictions_;
+   std::atomic<uint64_t> repeats_;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include "IncrementalCard.hh"
+#include "EventBatch.hh"
+
+bool IncrementalCard::getClusters(const uint16_t crystals[NCrystalsPerCard],
+      uint16_t sortedCluster_peakEta[RCTCard::NClusters],
+      uint16_t sortedCluster_peakPhi[RCTCard::NClusters],
+      uint16_t sortedCluster_towerEta[RCTCard::NClusters],
+      uint16_t sortedCluster_towerPhi[RCTCard::NClusters],
+      uint16_t sortedCluster_towerET[RCTCard::NClusters],
+      uint16_t sortedCluster_ET[RCTCard::NClusters]) {
+   bool success = true;
+   for (int iRegion = 0; iRegion < RCTCard::NRegions; iRegion++) {
+      RegionView region = cardRegion<RCTCard>(crystals, iRegion);
+      size_t first = region.data - crystals;
+      size_t n = region.nEta * RegionView::RowStride;
+      nRegions_++;
+      if (!valid_ || memcmp(&crystals[first], &crystals_[first], n * sizeof(uint16_t)) != 0) {
+	 std::copy_n(&crystals[first], n, &crystals_[first]);
+	 // Same as the region of mergeTowerClustersInCard: tower eta within the card
+	 Cluster clusters[NTowersPer3x4Region];
+	 regionMerged_[iRegion] = getMergedClustersInRegion(region, clusters);
+	 for (int k = 0; k < NTowersPer3x4Region; k++) {
+	    const Cluster &c = clusters[k];
+	    regionClusters_[iRegion][k] = Cluster(c.et(), c.towerET(), iRegion * 3 + c.towerEta(), c.towerPhi(),
+		  c.peakEta(), c.peakPhi());
+	 }
+	 selectClustersInRegion(regionClusters_[iRegion]);
+	 nRecomputed_++;
+      }
+      success &= regionMerged_[iRegion];
+   }
+   valid_ = true;
+   if (!success)
+      return false;
+
+   mergeClustersInCardSequential<RCTCard>(regionClusters_, sortedCluster_peakEta, sortedCluster_peakPhi,
+	 sortedCluster_towerEta, sortedCluster_towerPhi, sortedCluster_towerET, sortedCluster_ET);
+   return true;
+}
@@ -0,0 +1,48 @@
+#ifndef IncrementalCard_hh
+#define IncrementalCard_hh
+
+#include <stdint.h>
+
+#include "ClusterFinder.hh"
+
+/*
+ * getClustersInCard over a sequence of events of one card, recomputing only the
+ * regions whose crystals changed since the previous event.
+ *
+ * The clusters of a region only depend on its own crystals (tower clustering and
+ * the merging of split clusters stay within the region), which are a contiguous
+ * run of the tower-major card array: each region is compared with the previous
+ * event and, if it differs, clustered and selected again. The card level merge
+ * of the sorted region clusters always runs, so the output is that of a full
+ * recompute, failures included.
+ */
+class IncrementalCard {
+public:
+   IncrementalCard() : valid_(false), nRegions_(0), nRecomputed_(0) {}
+
+   // Forgets the previous event: the next one is computed in full
+   void reset() { valid_ = false; }
+
+   // Same as getClustersInCard<RCTCard>
+   bool getClusters(const uint16_t crystals[NCrystalsPerCard],
+	 uint16_t sortedCluster_peakEta[RCTCard::NClusters],
+	 uint16_t sortedCluster_peakPhi[RCTCard::NClusters],
+	 uint16_t sortedCluster_towerEta[RCTCard::NClusters],
+	 uint16_t sortedCluster_towerPhi[RCTCard::NClusters],
+	 uint16_t sortedCluster_towerET[RCTCard::NClusters],
+	 uint16_t sortedCluster_ET[RCTCard::NClusters]);
+
+   // Regions seen and regions recomputed since construction
+   uint64_t nRegions() const { return nRegions_; }
+   uint64_t nRecomputed() const { return nRecomputed_; }
+
+private:
+   bool valid_;
+   uint16_t crystals_[NCrystalsPerCard];
+   Cluster regionClusters_[RCTCard::NRegions][NTowersPer3x4Region];  // selected
+   bool regionMerged_[RCTCard::NRegions];
+   uint64_t nRegions_;
+   uint64_t nRecomputed_;
+};
+
+#endif
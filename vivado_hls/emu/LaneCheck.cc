@@ -0,0 +1,104 @@
+#include <stdint.h>
+
+#include <iostream>
+#include <vector>
+
+#include "LaneCheck.hh"
+#include "ClusterLanes.hh"
+
+using namespace std;
+
+namespace {
+
+// 64 bit xorshift, for reproducible random inputs
+struct Random {
+   uint64_t s;
+   Random() : s(0x9E3779B97F4A7C15ull) {}
+   uint64_t next() { s ^= s << 13; s ^= s >> 7; s ^= s << 17; return s; }
+};
+
+const size_t nBatch = 1000;
+const int NCrystalsPerTower = NCrystalsPerEtaPhi * NCrystalsPerEtaPhi;
+
+bool towersSameAsScalar(LaneIsa isa, uint64_t nTowers) {
+   Random rnd;
+   vector<uint16_t> crystals(nBatch * NCrystalsPerTower);
+   vector<uint16_t> lanes[4], scalar[4];
+   for (int i = 0; i < 4; i++) {
+      lanes[i].resize(nBatch);
+      scalar[i].resize(nBatch);
+   }
+   static const char *field[4] = { "peakEta", "peakPhi", "towerET", "clusterET" };
+   for (uint64_t first = 0; first < nTowers; first += nBatch) {
+      int kind = (first / nBatch) % 3;
+      for (size_t c = 0; c < crystals.size(); c++) {
+	 uint64_t r = rnd.next();
+	 if (kind == 0)
+	    crystals[c] = r;
+	 else if (kind == 1)
+	    crystals[c] = r & 0xF;
+	 else
+	    crystals[c] = (r & 0x1F) == 0 ? (r >> 8) & 0x3FFF : 0;
+      }
+      getClustersInTowers(&crystals[0], nBatch, &lanes[0][0], &lanes[1][0], &lanes[2][0], &lanes[3][0], isa);
+      getClustersInTowers(&crystals[0], nBatch, &scalar[0][0], &scalar[1][0], &scalar[2][0], &scalar[3][0], LaneScalar);
+      for (int i = 0; i < 4; i++) {
+	 for (size_t tower = 0; tower < nBatch; tower++) {
+	    if (lanes[i][tower] != scalar[i][tower]) {
+	       cout << "getClustersInTowers(" << laneIsaName(isa) << ") differs from getClustersInTower in " << field[i]
+		  << ": " << lanes[i][tower] << " instead of " << scalar[i][tower] << endl;
+	       return false;
+	    }
+	 }
+      }
+   }
+   cout << "getClustersInTowers(" << laneIsaName(isa) << ") same as getClustersInTower on "
+      << nTowers << " random towers" << endl;
+   return true;
+}
+
+bool selectionsSameAsScalar(LaneIsa isa, uint64_t nRegions) {
+   Random rnd;
+   static Cluster lanes[nBatch][NTowersPer3x4Region];
+   static Cluster scalar[nBatch][NTowersPer3x4Region];
+   for (uint64_t first = 0; first < nRegions; first += nBatch) {
+      bool fullET = (first / nBatch) % 2;
+      for (size_t region = 0; region < nBatch; region++) {
+	 for (int i = 0; i < NTowersPer3x4Region; i++) {
+	    lanes[region][i].data = rnd.next() & (fullET ? 0x0000FFFFFFFFFFFFull : 0x00000003FFFFFFFFull);
+	    scalar[region][i] = lanes[region][i];
+	 }
+      }
+      selectClustersInRegions(lanes, nBatch, isa);
+      selectClustersInRegions(scalar, nBatch, LaneScalar);
+      for (size_t region = 0; region < nBatch; region++) {
+	 for (int i = 0; i < NClustersPer3x4Region; i++) {
+	    if (lanes[region][i].data != scalar[region][i].data) {
+	       cout << "selectClustersInRegions(" << laneIsaName(isa) << ") differs from selectClustersInRegion at entry "
+		  << i << endl;
+	       return false;
+	    }
+	 }
+      }
+   }
+   cout << "selectClustersInRegions(" << laneIsaName(isa) << ") same as selectClustersInRegion on "
+      << nRegions << " random regions" << endl;
+   return true;
+}
+
+}
+
+bool checkLanes() {
+   const uint64_t nRandom = 1 << 18;
+   const LaneIsa isas[] = { LaneAVX2, LaneAVX512 };
+   bool ok = true;
+   for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+      if (!laneIsaSupported(isas[i])) {
+	 cout << laneIsaName(isas[i]) << " not supported here, skipped" << endl;
+	 continue;
+      }
+      ok &= towersSameAsScalar(isas[i], nRandom);
+      ok &= selectionsSameAsScalar(isas[i], nRandom);
+   }
+   return ok;
+}
@@ -0,0 +1,18 @@
+#ifndef LaneCheck_hh
+#define LaneCheck_hh
+
+/*
+ * Self checks of the vector lane kernels of ClusterLanes.hh (rct_emu --check-lanes),
+ * for every instruction set supported by the build and the CPU:
+ *  - getClustersInTowers against getClustersInTower, on random towers with crystal
+ *    ET over the full 16 bits (wrapping strip sums and saturated thresholds), small
+ *    ET (many weighted sums on a threshold) and a few hot crystals;
+ *  - selectClustersInRegions against selectClustersInRegion (the selected clusters),
+ *    on random regions with ET 0-3 (many ties) or over the full 16 bits (unsigned
+ *    compares).
+ * Batches are not a multiple of the lane counts, for the partly filled last vector.
+ * Prints a line per check; false if any failed.
+ */
+bool checkLanes();
+
+#endif
@@ -0,0 +1,99 @@
+#include <stdint.h>
+
+#include <iostream>
+
+#include "LinkFormatCheck.hh"
+#include "LinkFormat.hh"
+
+using namespace std;
+
+namespace {
+
+// 64 bit xorshift, for reproducible random inputs
+struct Random {
+   uint64_t s;
+   Random() : s(0x9E3779B97F4A7C15ull) {}
+   uint64_t next() { s ^= s << 13; s ^= s >> 7; s ^= s << 17; return s; }
+};
+
+// packClusters as it was before the layout table
+void legacyPackClusters(const uint16_t sortedCluster_peakEta[NClustersPerCard],
+      const uint16_t sortedCluster_peakPhi[NClustersPerCard],
+      const uint16_t sortedCluster_towerEta[NClustersPerCard],
+      const uint16_t sortedCluster_towerPhi[NClustersPerCard],
+      const uint16_t sortedCluster_ET[NClustersPerCard],
+      ap_uint<192> link_out[N_CH_OUT]) {
+   for (int idx = 0; idx < N_CH_OUT; idx++)
+      link_out[idx] = 0;
+   for (int item = 0; item < NClustersPerCard; item++) {
+      int olink = item / 3;
+      int word = item % 3;
+      int bLo1 = word * 32 + 32;
+      int bHi1 = bLo1 + 2;
+      for (int o = olink; o < N_CH_OUT; o += 4)
+	 link_out[o].range(bHi1, bLo1) = ap_uint<3>(sortedCluster_peakEta[item]);
+      int bLo2 = bHi1 + 1;
+      int bHi2 = bLo2 + 2;
+      for (int o = olink; o < N_CH_OUT; o += 4)
+	 link_out[o].range(bHi2, bLo2) = ap_uint<3>(sortedCluster_peakPhi[item]);
+      int bLo3 = bHi2 + 1;
+      int bHi3 = bLo3 + 5;
+      for (int o = olink; o < N_CH_OUT; o += 4)
+	 link_out[o].range(bHi3, bLo3) = ap_uint<6>(sortedCluster_towerEta[item]);
+      int bLo4 = bHi3 + 1;
+      int bHi4 = bLo4 + 3;
+      for (int o = olink; o < N_CH_OUT; o += 4)
+	 link_out[o].range(bHi4, bLo4) = ap_uint<4>(sortedCluster_towerPhi[item]);
+      int bLo5 = bHi4 + 1;
+      int bHi5 = bLo5 + 15;
+      for (int o = olink; o < N_CH_OUT; o += 4)
+	 link_out[o].range(bHi5, bLo5) = ap_uint<16>(sortedCluster_ET[item]);
+      int bLo6 = bHi5 + 1;
+      for (int o = olink; o < N_CH_OUT; o += 4)
+	 link_out[o].range(191, bLo6) = 0;
+   }
+}
+
+bool packSameAsLegacy(uint64_t nInputs) {
+   Random rnd;
+   uint16_t field[NClusterWordFields][NClustersPerCard];
+   uint16_t decoded[NClusterWordFields][NClustersPerCard];
+   ap_uint<192> links[N_CH_OUT], legacyLinks[N_CH_OUT];
+   for (uint64_t input = 0; input < nInputs; input++) {
+      for (int f = 0; f < NClusterWordFields; f++)
+	 for (int i = 0; i < NClustersPerCard; i++)
+	    field[f][i] = rnd.next();
+
+      packClusters(field[PeakEtaField], field[PeakPhiField], field[TowerEtaField], field[TowerPhiField],
+	    field[ETField], links, false);
+      legacyPackClusters(field[PeakEtaField], field[PeakPhiField], field[TowerEtaField], field[TowerPhiField],
+	    field[ETField], legacyLinks);
+      for (int o = 0; o < N_CH_OUT; o++) {
+	 if (links[o] != legacyLinks[o]) {
+	    cout << "packClusters differs from the legacy packer on link " << o << endl;
+	    return false;
+	 }
+      }
+
+      unpackClusters(links, decoded[PeakEtaField], decoded[PeakPhiField], decoded[TowerEtaField],
+	    decoded[TowerPhiField], decoded[ETField]);
+      for (int f = 0; f < NClusterWordFields; f++) {
+	 uint16_t mask = (1u << ClusterWordLayout[f].width) - 1;
+	 for (int i = 0; i < NClustersPerCard; i++) {
+	    if (decoded[f][i] != (field[f][i] & mask)) {
+	       cout << "unpackClusters does not give back field " << f << " of cluster " << i << endl;
+	       return false;
+	    }
+	 }
+      }
+   }
+   cout << "packClusters same as the legacy packer and undone by unpackClusters on " << nInputs
+      << " random cards" << endl;
+   return true;
+}
+
+}
+
+bool checkLinkFormat() {
+   return packSameAsLegacy(1 << 16);
+}
@@ -0,0 +1,14 @@
+#ifndef LinkFormatCheck_hh
+#define LinkFormatCheck_hh
+
+/*
+ * Self checks of the output link format of LinkFormat.hh (rct_emu --check-links):
+ *  - packClusters against the legacy per field range() packer (one write per field
+ *    and per fourth output link), on random clusters with fields wider than their
+ *    link field (truncation);
+ *  - unpackClusters of the packed links gives back the truncated clusters.
+ * Prints a line per check; false if any failed.
+ */
+bool checkLinkFormat();
+
+#endif
@@ -0,0 +1,144 @@
+
+#include "OutputComparator.hh"
+#include "LinkFormat.hh"
+
+using namespace std;
+
+namespace {
+
+const char *FieldName[NClusterWordFields] = { "peakEta", "peakPhi", "towerEta", "towerPhi", "ET" };
+
+// Link bits below and above the cluster words, compared as hex
+const int FirstHighBit = FirstClusterBit + NClustersPerLink * NClusterWordBits;
+const LinkField OtherBits[2] = { { 0, FirstClusterBit }, { FirstHighBit, 192 - FirstHighBit } };
+typedef char OtherBitsFitInWords[(FirstClusterBit <= 64 && 192 - FirstHighBit <= 64) ? 1 : -1];
+
+// Segments of a link: the low bits, the cluster words, the high bits
+const int NSegments = NClustersPerLink + 2;
+const int OtherBitsSegment[2] = { 0, NClustersPerLink + 1 };
+
+// Bits [lo, lo + width) of a link, width up to 64
+uint64_t bits(const ap_uint<192> &link, int lo, int width) {
+   uint64_t v = 0;
+   for (int done = 0; done < width;) {
+      int n = min(width - done, 64 - (lo + done) % 64);
+      v |= ap_uint<64>(link.range(lo + done + n - 1, lo + done)).to_uint64() << done;
+      done += n;
+   }
+   return v;
+}
+
+}
+
+OutputComparator::OutputComparator(size_t maxReports, ostream &log)
+   : log_(log), nLinks_(0), maxReports_(maxReports), nReports_(0), refDone_(false), nEvents_(0), nEventsDiffer_(0),
+   nEventsMissing_(0), nWordsDiffer_(0) {
+}
+
+bool OutputComparator::open(const string &name, const string &path, int nLinks, unsigned latency) {
+   if (!reader_.open(path))
+      return false;
+   if (reader_.nLinks() != nLinks) {
+      cerr << path << ": " << reader_.nLinks() << " links, the output has " << nLinks << endl;
+      return false;
+   }
+   name_ = name;
+   nLinks_ = nLinks;
+   ref_.resize(nLinks);
+   refWordCnt_.resize(1);
+   for (unsigned f = 0; f < latency; f++) {
+      if (reader_.read(&ref_[0], 1, &refWordCnt_[0]) != 1) {
+	 refDone_ = true;
+	 break;
+      }
+   }
+   return !reader_.failed();
+}
+
+bool OutputComparator::firstOf(uint32_t key) {
+   return reported_.insert(key).second && nReports_++ < maxReports_;
+}
+
+void OutputComparator::reportBits(uint64_t event, uint32_t refWordCnt, int l, int lo, int width, uint64_t word,
+      uint64_t refWord) {
+   log_ << name_ << ": event " << dec << event << " (reference word count 0x" << hex << refWordCnt << dec << ") link " << l
+      << " bits " << lo + width - 1 << "-" << lo << ": 0x" << hex << word << ", reference 0x" << refWord << dec << endl;
+}
+
+void OutputComparator::reportField(uint64_t event, uint32_t refWordCnt, int l, int cluster, int field, uint32_t value,
+      uint32_t refValue) {
+   log_ << name_ << ": event " << dec << event << " (reference word count 0x" << hex << refWordCnt << dec << ") link " << l
+      << " cluster " << cluster << " " << FieldName[field] << ": " << value << ", reference " << refValue << endl;
+}
+
+bool OutputComparator::compare(const ap_uint<192> *link, size_t stride, size_t n) {
+   ref_.resize(n * nLinks_);
+   refWordCnt_.resize(n);
+   size_t nRef = refDone_ ? 0 : reader_.read(&ref_[0], n, &refWordCnt_[0]);
+   if (nRef < n)
+      refDone_ = true;
+
+   bool same = true;
+   for (size_t i = 0; i < n; i++, nEvents_++) {
+      if (i >= nRef) {
+	 if (nEventsMissing_++ == 0)
+	    log_ << name_ << ": event " << nEvents_ << " and after: no reference frame" << endl;
+	 nEventsDiffer_++;
+	 same = false;
+	 continue;
+      }
+      bool eventSame = true;
+      for (int l = 0; l < nLinks_; l++) {
+	 const ap_uint<192> &out = link[i * stride + l], &ref = ref_[i * nLinks_ + l];
+	 if (out == ref)
+	    continue;
+	 eventSame = false;
+	 for (int r = 0; r < 2; r++) {
+	    const LinkField &b = OtherBits[r];
+	    if (b.width == 0)
+	       continue;
+	    uint64_t word = bits(out, b.lo, b.width), refWord = bits(ref, b.lo, b.width);
+	    if (word == refWord)
+	       continue;
+	    nWordsDiffer_++;
+	    if (firstOf((l * NSegments + OtherBitsSegment[r]) * NClusterWordFields))
+	       reportBits(nEvents_, refWordCnt_[i], l, b.lo, b.width, word, refWord);
+	 }
+	 for (int k = 0; k < NClustersPerLink; k++) {
+	    int lo = FirstClusterBit + k * NClusterWordBits;
+	    uint32_t word = bits(out, lo, NClusterWordBits), refWord = bits(ref, lo, NClusterWordBits);
+	    if (word == refWord)
+	       continue;
+	    nWordsDiffer_++;
+	    uint16_t field[NClusterWordFields], refField[NClusterWordFields];
+	    unpackClusterWord(word, field);
+	    unpackClusterWord(refWord, refField);
+	    int cluster = (l % NDistinctOutputLinks) * NClustersPerLink + k;
+	    for (int f = 0; f < NClusterWordFields; f++) {
+	       if (field[f] != refField[f] && firstOf((l * NSegments + 1 + k) * NClusterWordFields + f))
+		  reportField(nEvents_, refWordCnt_[i], l, cluster, f, field[f], refField[f]);
+	    }
+	 }
+      }
+      if (!eventSame) {
+	 nEventsDiffer_++;
+	 same = false;
+      }
+   }
+   return same;
+}
+
+bool OutputComparator::finish(bool stoppedEarly) {
+   uint64_t nLeft = 0;
+   ap_uint<192> *ref = &ref_[0];
+   while (!stoppedEarly && !refDone_ && reader_.read(ref, 1, &refWordCnt_[0]) == 1)
+      nLeft++;
+   if (nLeft > 0)
+      log_ << name_ << ": the reference has " << nLeft << " frames more than the output" << endl;
+   if (nReports_ > maxReports_)
+      log_ << name_ << ": " << nReports_ - maxReports_ << " more first mismatches not reported" << endl;
+   if (nEventsDiffer_ > 0)
+      log_ << name_ << ": " << nEventsDiffer_ << " of " << nEvents_ << " events differ from the reference ("
+	 << nWordsDiffer_ << " link words, " << nEventsMissing_ << " events without reference)" << endl;
+   return nEventsDiffer_ == 0 && nLeft == 0 && !reader_.failed();
+}
@@ -0,0 +1,67 @@
+#ifndef OutputComparator_hh
+#define OutputComparator_hh
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "algo_unpacked.h"
+#include "TestVector.hh"
+
+/*
+ * Streaming check of the output links against a reference output vector, block
+ * by block while the run goes on (in place of diff -w on the finished files).
+ *
+ * Output event f is compared with reference frame f + latency, the first latency
+ * reference frames being skipped; the word counts are not compared. A differing
+ * link word is decoded: the cluster words of LinkFormat.hh field by field, the
+ * other bits as hex. Only the first mismatch of each link, cluster word and
+ * field is reported, and at most maxReports of them; every mismatch is counted.
+ */
+class OutputComparator {
+public:
+   // Reports go to log
+   explicit OutputComparator(size_t maxReports = 10, std::ostream &log = std::cout);
+
+   // Opens the reference and skips its first latency frames; prints the error and
+   // returns false otherwise. name prefixes the reports
+   bool open(const std::string &name, const std::string &path, int nLinks, unsigned latency);
+
+   // Compares the next n output events, the links of event i at link + i * stride
+   // (nLinks of them); false if any differs
+   bool compare(const ap_uint<192> *link, size_t stride, size_t n);
+
+   // Reports the reference frames left over (unless the run stopped early) and the
+   // totals; true if all matched
+   bool finish(bool stoppedEarly = false);
+
+   uint64_t nEvents() const { return nEvents_; }
+   uint64_t nEventsDiffer() const { return nEventsDiffer_; }
+
+private:
+   void reportBits(uint64_t event, uint32_t refWordCnt, int l, int lo, int width, uint64_t word, uint64_t refWord);
+   void reportField(uint64_t event, uint32_t refWordCnt, int l, int cluster, int field, uint32_t value, uint32_t refValue);
+   // True if key was not seen yet and the report cap is not reached
+   bool firstOf(uint32_t key);
+
+   std::ostream &log_;
+   TextVectorReader reader_;
+   std::string name_;
+   int nLinks_;
+   size_t maxReports_;
+   size_t nReports_;
+   std::set<uint32_t> reported_;   // link, segment and field keys already reported
+   std::vector<ap_uint<192> > ref_;
+   std::vector<uint32_t> refWordCnt_;
+   bool refDone_;
+   uint64_t nEvents_;
+   uint64_t nEventsDiffer_;
+   uint64_t nEventsMissing_;       // without a reference frame
+   uint64_t nWordsDiffer_;
+};
+
+#endif
@@ -0,0 +1,287 @@
+#include <stdint.h>
+
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#include "SorterCheck.hh"
+#include "SortingNetwork.hh"
+#include "bitonicSorter.hh"
+#include "ClusterFinder.hh"
+
+using namespace std;
+
+namespace {
+
+// 64 bit xorshift, for reproducible random inputs
+struct Random {
+   uint64_t s;
+   Random() : s(0x9E3779B97F4A7C15ull) {}
+   uint64_t next() { s ^= s << 13; s ^= s >> 7; s ^= s << 17; return s; }
+};
+
+// First stage of the legacy sorts (blocks of 2 sorted in alternating directions),
+// followed by bitonic_1_4 (16 entries) or bitonic4 (32 entries)
+void legacySort(int n, uint16_t et[], uint16_t eta[], uint16_t phi[]) {
+   uint16_t xx;
+   for(int ii=0; ii<n; ii=ii+4){
+      if(et[ii] < et[ii+1]){
+	 xx=et[ii+1]; et[ii+1]=et[ii]; et[ii]=xx;
+	 xx=eta[ii]; eta[ii]=eta[ii+1]; eta[ii+1]=xx;
+	 xx=phi[ii]; phi[ii]=phi[ii+1]; phi[ii+1]=xx;
+      }
+      if(et[ii+2] > et[ii+3]){
+	 xx=et[ii+3]; et[ii+3]=et[ii+2]; et[ii+2]=xx;
+	 xx=eta[ii+2]; eta[ii+2]=eta[ii+3]; eta[ii+3]=xx;
+	 xx=phi[ii+2]; phi[ii+2]=phi[ii+3]; phi[ii+3]=xx;
+      }
+   }
+   if(n == 16)
+      bitonic_1_4(et, eta, phi);
+   else
+      bitonic4(et, eta, phi);
+}
+
+// Payload of the generic network: both legacy payload arrays
+struct Payload {
+   uint16_t eta;
+   uint16_t phi;
+   Payload() : eta(0), phi(0) {}
+};
+
+// Sets the 0-1 input of pattern bits (the entry index + 1 as payload, 0 being padding)
+// in the first n entries of key/payload and of the zero padded legacy arrays
+template<int N>
+void setInput(uint64_t bits, uint16_t key[N], Payload payload[N],
+      uint16_t et[], uint16_t eta[], uint16_t phi[], int nLegacy) {
+   for(int i = 0; i < nLegacy; i++) {
+      et[i] = eta[i] = phi[i] = 0;
+   }
+   for(int i = 0; i < N; i++) {
+      key[i] = et[i] = (bits >> i) & 1;
+      payload[i].eta = eta[i] = i + 1;
+      payload[i].phi = phi[i] = 100 + i;
+   }
+}
+
+// BitonicSorter<N> against the legacy sort of the input zero padded to nLegacy
+// entries, on the first N outputs
+template<int N>
+bool sameAsLegacy(int nLegacy, uint64_t nInputs, bool exhaustive) {
+   typedef BitonicSorter<N> Sorter;
+   Random rnd;
+   uint16_t key[N];
+   Payload payload[N];
+   uint16_t et[32], eta[32], phi[32];
+   for(uint64_t input = 0; input < nInputs; input++) {
+      uint64_t bits = exhaustive ? input : rnd.next();
+      setInput<N>(bits, key, payload, et, eta, phi, nLegacy);
+      Sorter::sort(key, payload);
+      legacySort(nLegacy, et, eta, phi);
+      for(int i = 0; i < N; i++) {
+	 if(key[i] != et[i] || payload[i].eta != eta[i] || payload[i].phi != phi[i]) {
+	    cout << "BitonicSorter<" << N << "> differs from the legacy " << nLegacy << " entry sort at output "
+	       << dec << i << " for input 0x" << hex << bits << dec << endl;
+	    return false;
+	 }
+      }
+   }
+   cout << "BitonicSorter<" << N << "> (" << Sorter::NComparators << " comparators in "
+      << Sorter::NStages << " stages) same as legacy " << nLegacy << " entry sort on " << nInputs
+      << (exhaustive ? " (all)" : " random") << " 0-1 inputs" << endl;
+   return true;
+}
+
+// Sortedness and payload consistency of BitonicSorter<N, Descending>
+template<int N, bool Descending>
+bool sorts(uint64_t nInputs, bool exhaustive) {
+   Random rnd;
+   uint16_t key[N];
+   Payload payload[N];
+   uint16_t et[N], eta[N], phi[N];
+   for(uint64_t input = 0; input < nInputs; input++) {
+      uint64_t bits = exhaustive ? input : rnd.next();
+      setInput<N>(bits, key, payload, et, eta, phi, N);
+      BitonicSorter<N, Descending>::sort(key, payload);
+      int nOnes = 0;
+      for(int i = 0; i < N; i++)
+	 nOnes += et[i];
+      for(int i = 0; i < N; i++) {
+	 uint16_t expected = Descending ? (i < nOnes) : (i >= N - nOnes);
+	 // Padding (payload 0) may only take the place of a 0 key
+	 bool payloadOk = payload[i].eta == 0 ? (Descending && key[i] == 0) : et[payload[i].eta - 1] == key[i];
+	 if(key[i] != expected || !payloadOk) {
+	    cout << "BitonicSorter<" << N << (Descending ? "" : ", ascending") << "> does not sort input 0x"
+	       << hex << bits << dec << endl;
+	    return false;
+	 }
+      }
+   }
+   cout << "BitonicSorter<" << N << (Descending ? "" : ", ascending") << "> sorts " << nInputs
+      << (exhaustive ? " (all)" : " random") << " 0-1 inputs" << endl;
+   return true;
+}
+
+// Reference order of the merged lists: stable sort of the concatenated lists
+struct ByKey {
+   const uint16_t *key;
+   bool descending;
+   bool operator()(int a, int b) const { return descending ? key[b] < key[a] : key[a] < key[b]; }
+};
+
+// SortedListMerger<NLists, L> merge and mergeSequential against a stable sort, on
+// random sorted lists of keys 0-3 (many ties)
+template<int NLists, int L, bool Descending>
+bool mergesStably(uint64_t nInputs) {
+   typedef SortedListMerger<NLists, L, Descending> Merger;
+   const int N = NLists * L;
+   Random rnd;
+   uint16_t key[N], outKey[N], seqKey[N];
+   Payload payload[N], outPayload[N], seqPayload[N];
+   int order[N];
+   ByKey byKey = { key, Descending };
+   for(uint64_t input = 0; input < nInputs; input++) {
+      for(int i = 0; i < N; i++) {
+	 key[i] = rnd.next() & 3;
+	 payload[i].eta = i + 1;
+	 order[i] = i;
+      }
+      for(int list = 0; list < NLists; list++) {
+	 if(Descending)
+	    std::sort(key + list * L, key + (list + 1) * L, std::greater<uint16_t>());
+	 else
+	    std::sort(key + list * L, key + (list + 1) * L);
+      }
+      std::stable_sort(order, order + N, byKey);
+
+      Merger::merge(key, payload, outKey, outPayload);
+      Merger::mergeSequential(key, payload, seqKey, seqPayload);
+      for(int i = 0; i < N; i++) {
+	 if(outKey[i] != key[order[i]] || outPayload[i].eta != order[i] + 1 ||
+	       seqKey[i] != key[order[i]] || seqPayload[i].eta != order[i] + 1) {
+	    cout << "SortedListMerger<" << NLists << ", " << L << (Descending ? "" : ", ascending")
+	       << "> is not a stable merge at output " << i << endl;
+	    return false;
+	 }
+      }
+   }
+   cout << "SortedListMerger<" << NLists << ", " << L << (Descending ? "" : ", ascending")
+      << "> merges " << nInputs << " random lists stably (" << Merger::NComparators << " comparators)" << endl;
+   return true;
+}
+
+// BitonicSelector<N, K, Descending> against a stable sort of the input: the same
+// first K keys, each with the payload of a distinct entry of that key (the
+// selector does not keep the order of equal keys). On all 0-1 inputs when
+// exhaustive, else on random keys 0-3 (many ties)
+template<int N, int K, bool Descending>
+bool selectsLikeStableSort(uint64_t nInputs, bool exhaustive) {
+   typedef BitonicSelector<N, K, Descending> Selector;
+   Random rnd;
+   uint16_t key[N], input[N];
+   Payload payload[N];
+   int order[N];
+   ByKey byKey = { input, Descending };
+   for(uint64_t n = 0; n < nInputs; n++) {
+      uint64_t bits = rnd.next();
+      for(int i = 0; i < N; i++) {
+	 key[i] = input[i] = exhaustive ? (n >> i) & 1 : (bits >> (2 * (i % 32))) & 3;
+	 payload[i].eta = i;
+	 order[i] = i;
+	 if(i % 32 == 31)
+	    bits = rnd.next();
+      }
+      std::stable_sort(order, order + N, byKey);
+      Selector::select(key, payload);
+
+      bool used[N] = { false };
+      for(int i = 0; i < K; i++) {
+	 int entry = payload[i].eta;
+	 if(key[i] != input[order[i]] || entry >= N || used[entry] || input[entry] != key[i]) {
+	    cout << "BitonicSelector<" << N << ", " << K << (Descending ? "" : ", ascending")
+	       << "> differs from a stable sort at output " << i << endl;
+	    return false;
+	 }
+	 used[entry] = true;
+      }
+   }
+   cout << "BitonicSelector<" << N << ", " << K << (Descending ? "" : ", ascending") << "> ("
+      << Selector::NComparators << " comparators in " << Selector::NStages << " stages) selects like a stable sort on "
+      << nInputs << (exhaustive ? " (all) 0-1" : " random") << " inputs" << endl;
+   return true;
+}
+
+// BitonicSelector<N, K> and SortedListMerger<NLists, N / NLists> on packed Cluster
+// keys against the same networks on the ET with the other fields as payload, on
+// random clusters with ET 0-3 (many ties)
+template<int N, int K, int NLists>
+bool clusterKeysSameAsPayload(uint64_t nInputs) {
+   typedef SortedListMerger<NLists, N / NLists> Merger;
+   Random rnd;
+   Cluster cluster[N], mergedCluster[N];
+   uint16_t key[N], mergedKey[N];
+   Payload payload[N], mergedPayload[N];
+   for(uint64_t input = 0; input < nInputs; input++) {
+      for(int i = 0; i < N; i++) {
+	 uint64_t r = rnd.next();
+	 key[i] = r & 3;
+	 payload[i].eta = i + 1;
+	 payload[i].phi = (r >> 8) & 0x7;
+	 cluster[i] = Cluster(key[i], r >> 16, payload[i].eta, (r >> 12) & 0xF, (r >> 4) & 0x7, payload[i].phi);
+      }
+      BitonicSelector<N, K>::select(cluster);
+      BitonicSelector<N, K>::select(key, payload);
+      for(int i = 0; i < K; i++) {
+	 if(cluster[i].et() != key[i] || cluster[i].towerEta() != payload[i].eta || cluster[i].peakPhi() != payload[i].phi) {
+	    cout << "BitonicSelector<" << N << ", " << K << "> on Cluster keys differs at output " << i << endl;
+	    return false;
+	 }
+      }
+
+      for(int list = 0; list < NLists; list++) {
+	 BitonicSorter<N / NLists>::sort(cluster + list * (N / NLists));
+	 BitonicSorter<N / NLists>::sort(key + list * (N / NLists), payload + list * (N / NLists));
+      }
+      Merger::merge(cluster, mergedCluster);
+      Merger::merge(key, payload, mergedKey, mergedPayload);
+      for(int i = 0; i < N; i++) {
+	 if(mergedCluster[i].et() != mergedKey[i] || mergedCluster[i].towerEta() != mergedPayload[i].eta) {
+	    cout << "SortedListMerger<" << NLists << ", " << N / NLists << "> on Cluster keys differs at output " << i << endl;
+	    return false;
+	 }
+      }
+   }
+   cout << "BitonicSelector<" << N << ", " << K << "> and SortedListMerger<" << NLists << ", " << N / NLists
+      << "> same on Cluster keys as on ET with payload for " << nInputs << " random inputs" << endl;
+   return true;
+}
+
+}
+
+bool checkSorters() {
+   const uint64_t nRandom = 1 << 18;
+   bool ok = true;
+   ok &= sameAsLegacy<16>(16, 1 << 16, true);
+   ok &= sameAsLegacy<32>(32, nRandom, false);
+   ok &= sameAsLegacy<10>(16, 1 << 10, true);   // CTP7 card
+   ok &= sameAsLegacy<12>(16, 1 << 12, true);
+   ok &= sameAsLegacy<30>(32, nRandom, false);  // VU9P card
+   ok &= sorts<5, true>(1 << 5, true);
+   ok &= sorts<20, true>(1 << 20, true);
+   ok &= sorts<20, false>(1 << 20, true);
+   ok &= sorts<36, true>(nRandom, false);
+   ok &= sorts<64, true>(nRandom, false);
+   ok &= selectsLikeStableSort<12, 5, true>(1 << 12, true);    // 3x4 region
+   ok &= selectsLikeStableSort<12, 5, true>(nRandom, false);
+   ok &= selectsLikeStableSort<16, 1, true>(1 << 16, true);
+   ok &= selectsLikeStableSort<20, 20, true>(1 << 20, true);
+   ok &= selectsLikeStableSort<17, 5, false>(1 << 17, true);
+   ok &= selectsLikeStableSort<30, 12, true>(nRandom, false);
+   ok &= selectsLikeStableSort<64, 8, true>(nRandom, false);
+   ok &= mergesStably<2, 5, true>(nRandom);   // CTP7 card
+   ok &= mergesStably<6, 5, true>(nRandom);   // VU9P card
+   ok &= mergesStably<3, 4, false>(nRandom);
+   ok &= clusterKeysSameAsPayload<12, 5, 2>(nRandom);   // 3x4 region
+   ok &= clusterKeysSameAsPayload<30, 30, 6>(nRandom);  // VU9P card
+   return ok;
+}
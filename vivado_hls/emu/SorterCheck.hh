@@ -0,0 +1,29 @@
+#ifndef SorterCheck_hh
+#define SorterCheck_hh
+
+/*
+ * Self checks of the sorting networks used by the algorithm (rct_emu --check-sorters).
+ *
+ * By the 0-1 principle a comparator network sorts every input if it sorts every
+ * input of 0s and 1s, and two networks compute the same keys on every input if
+ * they agree on every 0-1 input. The checks run the networks on 0-1 inputs with
+ * the entry index as payload, so that the routing of equal keys (which decides
+ * the bits sent out for clusters of equal ET) is compared as well:
+ *  - BitonicSorter<16> and <32> against the legacy bitonicSorter.cc sorts (with
+ *    their first stage of comparators, which used to live in ClusterFinder.cc),
+ *    exhaustively for 16 entries and on random inputs for 32;
+ *  - BitonicSorter<N> for the unpadded sizes used by the algorithm against the
+ *    legacy sorts of the explicitly zero padded arrays;
+ *  - the top-K BitonicSelector<N, K> against a stable sort, same keys and a
+ *    distinct entry of that key at each output (ties may come out in another
+ *    order), on all 0-1 inputs or random inputs with many equal keys;
+ *  - sortedness of BitonicSorter<N> on all 0-1 inputs (random ones for more than 20 entries);
+ *  - SortedListMerger merge and mergeSequential against a stable sort, on random
+ *    lists with many equal keys;
+ *  - the selectors and mergers on packed Cluster keys against the same networks
+ *    on the ET with the other fields as payload.
+ * Prints a line per check; false if any failed.
+ */
+bool checkSorters();
+
+#endif
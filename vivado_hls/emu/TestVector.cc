@@ -0,0 +1,586 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <iostream>
+#include <algorithm>
+
+#include "TestVector.hh"
+
+using namespace std;
+
+const char VectorFileMagic[8] = { 'R', 'C', 'T', 'V', 'E', 'C', '0', '1' };
+
+bool isVectorFile(const string &path) {
+   ifstream ifs(path.c_str(), ios::binary);
+   char magic[sizeof(VectorFileMagic)];
+   return ifs.read(magic, sizeof(magic)) && memcmp(magic, VectorFileMagic, sizeof(magic)) == 0;
+}
+
+string textHeader(int nLinks) {
+   string links("WordCnt             ");
+   for (int link = 0; link < nLinks; link++) {
+      char name[16];
+      snprintf(name, sizeof(name), "LINK_%02d", link);
+      links += name;
+      if (link != nLinks - 1) links += "               ";
+   }
+   return string(links.size(), '=') + "\n" + links + "\n#BeginData\n";
+}
+
+namespace {
+
+const uint64_t Ones = 0x0101010101010101ull;
+
+// Bytes of x (all below 0x80) between a and b, as their bit 7
+inline uint64_t bytesBetween(uint64_t x, uint8_t a, uint8_t b) {
+   return ~(x + Ones * (127 - b)) & (x + Ones * (128 - a)) & (Ones * 0x80);
+}
+
+// 8 hex digits (first one most significant) -> 32 bits; false if one is not a hex digit
+inline bool decodeHex8(const char *p, uint32_t &value) {
+   uint64_t x;
+   memcpy(&x, p, sizeof(x));
+   uint64_t lower = x | (Ones * 0x20);  // 'A'-'F' -> 'a'-'f', digits unchanged
+   if ((x & (Ones * 0x80)) != 0 || (bytesBetween(lower, '0', '9') | bytesBetween(lower, 'a', 'f')) != Ones * 0x80)
+      return false;
+   // Digit values ('a' and 'A' have bit 6 set), then pairs, quads and octets of them
+   uint64_t v = (x & (Ones * 0x0F)) + 9 * ((x >> 6) & Ones);
+   v = ((v << 4) | (v >> 8)) & 0x00FF00FF00FF00FFull;
+   v = ((v << 8) | (v >> 16)) & 0x0000FFFF0000FFFFull;
+   v = ((v << 16) | (v >> 32)) & 0x00000000FFFFFFFFull;
+   value = (uint32_t) v;
+   return true;
+}
+
+inline int hexDigit(char c) {
+   if (c >= '0' && c <= '9') return c - '0';
+   if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+   if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+   return -1;
+}
+
+// Hex token, with or without 0x, of up to 16 digits
+bool decodeHex(const char *p, size_t length, uint64_t &value) {
+   if (length >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+      p += 2;
+      length -= 2;
+   }
+   if (length == 16) {
+      uint32_t hi, lo;
+      if (!decodeHex8(p, hi) || !decodeHex8(p + 8, lo))
+	 return false;
+      value = ((uint64_t) hi << 32) | lo;
+      return true;
+   }
+   if (length == 0 || length > 16)
+      return false;
+   value = 0;
+   for (size_t i = 0; i < length; i++) {
+      int d = hexDigit(p[i]);
+      if (d < 0)
+	 return false;
+      value = (value << 4) | d;
+   }
+   return true;
+}
+
+inline bool isSpace(char c) {
+   return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+}
+
+TextVectorReader::TextVectorReader(size_t blockSize)
+   : fd_(-1), buffer_(blockSize), pos_(0), end_(0), eof_(true), failed_(false), nLinks_(0), nFrames_(0) {
+}
+
+bool TextVectorReader::open(const string &path, int defaultNLinks) {
+   close();
+   fd_ = ::open(path.c_str(), O_RDONLY);
+   if (fd_ < 0) {
+      cerr << "Error opening input file: " << path << endl;
+      return false;
+   }
+   posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+   path_ = path;
+   pos_ = end_ = 0;
+   eof_ = failed_ = false;
+   nLinks_ = 0;
+   nFrames_ = 0;
+
+   // Up to #BeginData, counting the LINK_xx columns on the way
+   const char *token;
+   size_t length;
+   while (nextToken(token, length)) {
+      if (length == 10 && memcmp(token, "#BeginData", 10) == 0) {
+	 if (nLinks_ == 0) nLinks_ = defaultNLinks;
+	 return true;
+      }
+      if (length >= 5 && memcmp(token, "LINK_", 5) == 0)
+	 nLinks_++;
+   }
+   if (!failed_)
+      cerr << path << ": no #BeginData" << endl;
+   close();
+   return false;
+}
+
+void TextVectorReader::close() {
+   if (fd_ >= 0)
+      ::close(fd_);
+   fd_ = -1;
+   pos_ = end_ = 0;
+   eof_ = true;
+}
+
+bool TextVectorReader::fill() {
+   if (eof_)
+      return false;
+   if (pos_ > 0) {
+      memmove(buffer_.data(), buffer_.data() + pos_, end_ - pos_);
+      end_ -= pos_;
+      pos_ = 0;
+   }
+   if (end_ == buffer_.size()) {
+      cerr << path_ << ": token longer than " << buffer_.size() << " bytes" << endl;
+      failed_ = true;
+      return false;
+   }
+   ssize_t n;
+   while ((n = ::read(fd_, buffer_.data() + end_, buffer_.size() - end_)) < 0 && errno == EINTR)
+      ;
+   if (n < 0) {
+      cerr << path_ << ": read failed" << endl;
+      failed_ = true;
+   }
+   if (n <= 0) {
+      eof_ = true;
+      return false;
+   }
+   end_ += n;
+   return true;
+}
+
+bool TextVectorReader::nextToken(const char *&token, size_t &length) {
+   for (;;) {
+      while (pos_ < end_ && isSpace(buffer_[pos_]))
+	 pos_++;
+      if (pos_ < end_)
+	 break;
+      if (!fill())
+	 return false;
+   }
+   // The token must end before the end of the buffer, unless the file ends there
+   size_t e = pos_;
+   for (;;) {
+      while (e < end_ && !isSpace(buffer_[e]))
+	 e++;
+      if (e < end_ || eof_)
+	 break;
+      e -= pos_;
+      if (!fill() && failed_)
+	 return false;
+      e += pos_;
+   }
+   token = buffer_.data() + pos_;
+   length = e - pos_;
+   pos_ = e;
+   return true;
+}
+
+bool TextVectorReader::readWord(uint64_t &word) {
+   const char *token;
+   size_t length;
+   if (!nextToken(token, length))
+      return false;
+   if (!decodeHex(token, length, word)) {
+      cerr << path_ << ": frame " << nFrames_ << ": not a hex word: " << string(token, min<size_t>(length, 40)) << endl;
+      failed_ = true;
+      return false;
+   }
+   return true;
+}
+
+size_t TextVectorReader::read(ap_uint<192> *link, size_t maxFrames, uint32_t *wordCnt, uint32_t *cycleWordCnt) {
+   size_t n = 0;
+   for (; n < maxFrames && !failed_; n++) {
+      ap_uint<192> *frame = link + n * nLinks_;
+      for (int cyc = 0; cyc < NCyclesPerFrame; cyc++) {
+	 uint64_t word;
+	 if (!readWord(word))
+	    return n;
+	 wordCnt[n] = word;
+	 if (cycleWordCnt) cycleWordCnt[n * NCyclesPerFrame + cyc] = word;
+	 for (int l = 0; l < nLinks_; l++) {
+	    if (!readWord(word))
+	       return n;
+	    frame[l].range(64 * cyc + 63, 64 * cyc) = word;
+	 }
+      }
+      nFrames_++;
+   }
+   return n;
+}
+
+namespace {
+
+// "00" ... "ff"
+struct HexPairs {
+   char digits[256][2];
+   constexpr HexPairs() : digits() {
+      const char hex[] = "0123456789abcdef";
+      for (int i = 0; i < 256; i++) {
+	 digits[i][0] = hex[i >> 4];
+	 digits[i][1] = hex[i & 15];
+      }
+   }
+};
+constexpr HexPairs hexPairs;
+
+inline char *formatHex64(char *out, uint64_t v) {
+   for (int b = 7; b >= 0; b--, out += 2)
+      memcpy(out, hexPairs.digits[(v >> (8 * b)) & 0xFF], 2);
+   return out;
+}
+
+// Hex digits of a word count printed with setw(4)
+inline int wordCntDigits(uint32_t wordCnt) {
+   int n = 4;
+   while (n < 8 && (wordCnt >> (4 * n)) != 0)
+      n++;
+   return n;
+}
+
+const char WordCntSpace[] = "   ";
+const char LinkSpace[] = "    ";
+const size_t LinkWordSize = 2 + 16 + sizeof(LinkSpace) - 1;
+
+}
+
+size_t textFrameSize(int nLinks, uint32_t wordCnt) {
+   size_t size = 0;
+   for (int cyc = 0; cyc < NCyclesPerFrame; cyc++)
+      size += 2 + wordCntDigits(wordCnt + cyc) + sizeof(WordCntSpace) - 1 + nLinks * LinkWordSize + 1;
+   return size;
+}
+
+char *formatTextFrame(char *out, const ap_uint<192> *link, int nLinks, uint32_t wordCnt) {
+   for (int cyc = 0; cyc < NCyclesPerFrame; cyc++, wordCnt++) {
+      *out++ = '0';
+      *out++ = 'x';
+      int digits = wordCntDigits(wordCnt);
+      for (int d = digits - 1; d >= 0; d--)
+	 *out++ = "0123456789abcdef"[(wordCnt >> (4 * d)) & 15];
+      memcpy(out, WordCntSpace, sizeof(WordCntSpace) - 1);
+      out += sizeof(WordCntSpace) - 1;
+      for (int l = 0; l < nLinks; l++) {
+	 *out++ = '0';
+	 *out++ = 'x';
+	 out = formatHex64(out, ap_uint<64>(link[l].range(64 * cyc + 63, 64 * cyc)).to_uint64());
+	 memcpy(out, LinkSpace, sizeof(LinkSpace) - 1);
+	 out += sizeof(LinkSpace) - 1;
+      }
+      *out++ = '\n';
+   }
+   return out;
+}
+
+TextVectorWriter::TextVectorWriter(size_t blockSize)
+   : fd_(-1), buffer_(blockSize), end_(0), nLinks_(0), failed_(false) {
+}
+
+bool TextVectorWriter::open(const string &path, int nLinks) {
+   close();
+   fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd_ < 0) {
+      cerr << "Error opening output file: " << path << endl;
+      return false;
+   }
+   path_ = path;
+   nLinks_ = nLinks;
+   failed_ = false;
+   end_ = 0;
+   string header(textHeader(nLinks));
+   if (buffer_.size() < header.size())
+      buffer_.resize(header.size());
+   memcpy(buffer_.data(), header.data(), header.size());
+   end_ = header.size();
+   return true;
+}
+
+void TextVectorWriter::write(const ap_uint<192> *link, uint32_t wordCnt) {
+   size_t size = textFrameSize(nLinks_, wordCnt);
+   if (end_ + size > buffer_.size()) {
+      flush();
+      if (size > buffer_.size())
+	 buffer_.resize(size);
+   }
+   end_ = formatTextFrame(buffer_.data() + end_, link, nLinks_, wordCnt) - buffer_.data();
+}
+
+void TextVectorWriter::flush() {
+   for (size_t done = 0; done < end_ && !failed_;) {
+      ssize_t n = ::write(fd_, buffer_.data() + done, end_ - done);
+      if (n < 0 && errno == EINTR)
+	 continue;
+      if (n <= 0) {
+	 cerr << "Error writing " << path_ << endl;
+	 failed_ = true;
+      }
+      else
+	 done += n;
+   }
+   end_ = 0;
+}
+
+bool TextVectorWriter::close() {
+   if (fd_ < 0)
+      return !failed_;
+   flush();
+   if (::close(fd_) != 0 && !failed_) {
+      cerr << "Error writing " << path_ << endl;
+      failed_ = true;
+   }
+   fd_ = -1;
+   return !failed_;
+}
+
+bool OffsetTextWriter::open(const string &path, int nLinks) {
+   close();
+   fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd_ < 0) {
+      cerr << "Error opening output file: " << path << endl;
+      return false;
+   }
+   path_ = path;
+   nLinks_ = nLinks;
+   failed_ = false;
+   string header(textHeader(nLinks));
+   end_ = header.size();
+   if (pwrite(fd_, header.data(), header.size(), 0) != (ssize_t) header.size()) {
+      cerr << "Error writing " << path_ << endl;
+      failed_ = true;
+   }
+   return true;
+}
+
+void OffsetTextWriter::layout(const uint32_t *wordCnt, size_t n) {
+   offset_.resize(n + 1);
+   wordCnt_.assign(wordCnt, wordCnt + n);
+   for (size_t i = 0; i < n; i++) {
+      offset_[i] = end_;
+      end_ += textFrameSize(nLinks_, wordCnt[i]);
+   }
+   offset_[n] = end_;
+}
+
+void OffsetTextWriter::write(const ap_uint<192> *link, size_t stride, size_t begin, size_t end) {
+   thread_local vector<char> buffer;
+   buffer.resize(offset_[end] - offset_[begin]);
+   char *out = buffer.data();
+   for (size_t i = begin; i < end; i++)
+      out = formatTextFrame(out, link + (i - begin) * stride, nLinks_, wordCnt_[i]);
+   for (size_t done = 0; done < buffer.size() && !failed_;) {
+      ssize_t n = pwrite(fd_, buffer.data() + done, buffer.size() - done, offset_[begin] + done);
+      if (n < 0 && errno == EINTR)
+	 continue;
+      if (n <= 0) {
+	 if (!failed_.exchange(true))
+	    cerr << "Error writing " << path_ << endl;
+      }
+      else
+	 done += n;
+   }
+}
+
+bool OffsetTextWriter::close() {
+   if (fd_ < 0)
+      return !failed_;
+   if (::close(fd_) != 0 && !failed_) {
+      cerr << "Error writing " << path_ << endl;
+      failed_ = true;
+   }
+   fd_ = -1;
+   return !failed_;
+}
+
+bool MappedVectorFile::open(const string &path) {
+   close();
+   int fd = ::open(path.c_str(), O_RDONLY);
+   if (fd < 0) {
+      cerr << "Error opening input file: " << path << endl;
+      return false;
+   }
+   struct stat st;
+   if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(VectorFileHeader)) {
+      cerr << path << ": not a binary vector file" << endl;
+      ::close(fd);
+      return false;
+   }
+   // Writable private pages: the links are handed out as ap_uint<192> *
+   void *p = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   ::close(fd);
+   if (p == MAP_FAILED) {
+      cerr << path << ": mmap failed" << endl;
+      return false;
+   }
+   madvise(p, st.st_size, MADV_SEQUENTIAL);
+   data_ = (char *) p;
+   size_ = st.st_size;
+   header_ = (const VectorFileHeader *) data_;
+
+   const VectorFileHeader &h = *header_;
+   const char *error = 0;
+   if (memcmp(h.magic, VectorFileMagic, sizeof(VectorFileMagic)) != 0)
+      error = "not a binary vector file";
+   else if (h.byteOrder != VectorFileByteOrder)
+      error = "written with the other byte order";
+   else if (h.nCycles != NCyclesPerFrame || h.nLinks == 0)
+      error = "unsupported frame layout";
+   else if ((size_ - sizeof(VectorFileHeader)) / (h.nLinks * NCyclesPerFrame * sizeof(uint64_t)) < h.nFrames)
+      error = "truncated";
+   if (error) {
+      cerr << path << ": " << error << endl;
+      close();
+      return false;
+   }
+   return true;
+}
+
+void MappedVectorFile::close() {
+   if (data_)
+      munmap(data_, size_);
+   data_ = 0;
+   size_ = 0;
+   header_ = 0;
+}
+
+ap_uint<192> *MappedVectorFile::frames(uint64_t first, size_t n, vector<ap_uint<192> > &scratch) const {
+#ifndef RCT_EMU_AP_INT
+   static_assert(sizeof(ap_uint<192>) == NCyclesPerFrame * sizeof(uint64_t), "BitVector<192> is three words");
+   (void) n;
+   (void) scratch;
+   return (ap_uint<192> *) words(first);
+#else
+   size_t nWords = n * nLinks() * NCyclesPerFrame;
+   scratch.resize(n * nLinks());
+   const uint64_t *w = words(first);
+   for (size_t i = 0; i < nWords; i++)
+      scratch[i / NCyclesPerFrame].range(64 * (i % NCyclesPerFrame) + 63, 64 * (i % NCyclesPerFrame)) = w[i];
+   return scratch.data();
+#endif
+}
+
+bool VectorFileWriter::open(const string &path, uint32_t nLinks, uint32_t firstWordCnt) {
+   ofs_.open(path.c_str(), ios::binary | ios::trunc);
+   if (!ofs_.is_open()) {
+      cerr << "Error opening output file: " << path << endl;
+      return false;
+   }
+   path_ = path;
+   memset(&header_, 0, sizeof(header_));
+   memcpy(header_.magic, VectorFileMagic, sizeof(VectorFileMagic));
+   header_.byteOrder = VectorFileByteOrder;
+   header_.nLinks = nLinks;
+   header_.nCycles = NCyclesPerFrame;
+   header_.firstWordCnt = firstWordCnt;
+   nLinks_ = nLinks;
+   nFrames_ = 0;
+   words_.resize(nLinks * NCyclesPerFrame);
+   // Written again by close() with the frame count
+   ofs_.write((const char *) &header_, sizeof(header_));
+   return true;
+}
+
+void VectorFileWriter::write(const ap_uint<192> *link) {
+   for (uint32_t l = 0; l < nLinks_; l++)
+      for (int cyc = 0; cyc < NCyclesPerFrame; cyc++)
+	 words_[l * NCyclesPerFrame + cyc] = ap_uint<64>(link[l].range(64 * cyc + 63, 64 * cyc)).to_uint64();
+   ofs_.write((const char *) words_.data(), words_.size() * sizeof(uint64_t));
+   nFrames_++;
+}
+
+bool VectorFileWriter::close() {
+   header_.nFrames = nFrames_;
+   ofs_.seekp(0);
+   ofs_.write((const char *) &header_, sizeof(header_));
+   ofs_.close();
+   if (ofs_.fail()) {
+      cerr << "Error writing " << path_ << endl;
+      return false;
+   }
+   return true;
+}
+
+namespace {
+
+bool textToBinary(const string &in, const string &out) {
+   TextVectorReader reader;
+   if (!reader.open(in))
+      return false;
+   int nLinks = reader.nLinks();
+   if (nLinks == 0) {
+      cerr << in << ": no LINK_xx columns before #BeginData" << endl;
+      return false;
+   }
+
+   VectorFileWriter writer;
+   vector<ap_uint<192> > link(nLinks);
+   uint32_t wordCnt, cycleWordCnt[NCyclesPerFrame];
+   uint64_t nFrames = 0;
+   uint32_t firstWordCnt = 0;
+   while (reader.read(&link[0], 1, &wordCnt, cycleWordCnt) == 1) {
+      if (nFrames == 0) {
+	 firstWordCnt = cycleWordCnt[0];
+	 if (!writer.open(out, nLinks, firstWordCnt))
+	    return false;
+      }
+      for (int cyc = 0; cyc < NCyclesPerFrame; cyc++) {
+	 if (cycleWordCnt[cyc] != (uint32_t) (firstWordCnt + NCyclesPerFrame * nFrames + cyc)) {
+	    cerr << in << ": word count 0x" << hex << cycleWordCnt[cyc] << dec << " of frame " << nFrames
+	       << " does not follow the previous one" << endl;
+	    writer.close();
+	    return false;
+	 }
+      }
+      writer.write(&link[0]);
+      nFrames++;
+   }
+   if (reader.failed()) {
+      if (nFrames > 0) writer.close();
+      return false;
+   }
+   if (nFrames == 0 && !writer.open(out, nLinks, 0))
+      return false;
+   if (!writer.close())
+      return false;
+   cout << in << " -> " << out << ": " << nFrames << " frames of " << nLinks << " links" << endl;
+   return true;
+}
+
+bool binaryToText(const string &in, const string &out) {
+   MappedVectorFile vf;
+   if (!vf.open(in))
+      return false;
+   TextVectorWriter writer;
+   if (!writer.open(out, vf.nLinks()))
+      return false;
+   vector<ap_uint<192> > scratch;
+   for (uint64_t f = 0; f < vf.nFrames(); f++)
+      writer.write(vf.frames(f, 1, scratch), vf.wordCnt(f) - (NCyclesPerFrame - 1));
+   if (!writer.close())
+      return false;
+   cout << in << " -> " << out << ": " << vf.nFrames() << " frames of " << vf.nLinks() << " links" << endl;
+   return true;
+}
+
+}
+
+bool convertVectorFile(const string &in, const string &out) {
+   return isVectorFile(in) ? binaryToText(in, out) : textToBinary(in, out);
+}
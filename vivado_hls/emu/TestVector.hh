@@ -0,0 +1,233 @@
+#ifndef TestVector_hh
+#define TestVector_hh
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ostream>
+#include <fstream>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "algo_unpacked.h"
+
+/*
+ * Test vector files: the APx text format read and written by algo_unpacked_tb.cpp,
+ * and a binary format holding the same frames that the emulator maps in memory
+ * instead of parsing them.
+ *
+ * Text format: a header (a line of '=', the WordCnt and LINK_xx column names,
+ * #BeginData), then 3 lines per frame, one per 64 bit cycle: the hex word count
+ * and the hex word of every link. TextVectorReader parses it from large blocks
+ * read in turn, so that it runs in constant memory on files of any size.
+ *
+ * Binary format (native byte order, checked on open): a VectorFileHeader, then
+ * nFrames frames of nLinks x 3 64 bit words, link major: word 3 * link + cycle
+ * of a frame is range(64 * cycle + 63, 64 * cycle) of that link, so a link is
+ * the three words of an ap_uint<192>. Word counts are not stored: cycle c of
+ * frame f has firstWordCnt + 3 * f + c, and text vectors whose counts do not
+ * follow are not converted.
+ */
+
+const int NCyclesPerFrame = 3;
+
+struct VectorFileHeader {
+   char magic[8];          // VectorFileMagic
+   uint32_t byteOrder;     // VectorFileByteOrder as written
+   uint32_t nLinks;
+   uint32_t nCycles;       // NCyclesPerFrame
+   uint32_t firstWordCnt;
+   uint64_t nFrames;
+   uint64_t reserved[4];
+};
+static_assert(sizeof(VectorFileHeader) == 64, "VectorFileHeader must stay 64 bytes");
+
+extern const char VectorFileMagic[8];
+const uint32_t VectorFileByteOrder = 0x01020304;
+
+// True if the file starts with VectorFileMagic
+bool isVectorFile(const std::string &path);
+
+// Text header of nLinks links
+std::string textHeader(int nLinks);
+
+/*
+ * Streaming parser of text vectors. The whitespace separated tokens are found in
+ * place in the block buffer and decoded straight into the caller's links: the
+ * 0x%016x link words with a branch free 8 characters at a time decoder, other
+ * hex tokens (with or without 0x, up to 16 digits) one character at a time.
+ * A frame cut short by the end of the file is dropped, as by algo_unpacked_tb.cpp.
+ */
+class TextVectorReader {
+public:
+   explicit TextVectorReader(size_t blockSize = 1 << 20);
+   ~TextVectorReader() { close(); }
+   TextVectorReader(const TextVectorReader &) = delete;
+   TextVectorReader &operator=(const TextVectorReader &) = delete;
+
+   // Opens path and skips the header, counting its LINK_xx columns (defaultNLinks if
+   // there are none); prints the error and returns false otherwise
+   bool open(const std::string &path, int defaultNLinks = 0);
+   void close();
+
+   int nLinks() const { return nLinks_; }
+
+   // Reads up to maxFrames frames into link (nLinks() per frame); returns the number
+   // read, 0 at the end of the file or after a malformed token (see failed()).
+   // wordCnt[i] is the count of the last cycle of frame i, as in algo_unpacked_tb.cpp;
+   // cycleWordCnt, if given, gets the counts of every cycle
+   size_t read(ap_uint<192> *link, size_t maxFrames, uint32_t *wordCnt, uint32_t *cycleWordCnt = 0);
+
+   // True after a malformed token, which has been reported
+   bool failed() const { return failed_; }
+
+private:
+   // Next whitespace separated token, in the buffer; false at the end of the file
+   bool nextToken(const char *&token, size_t &length);
+   bool readWord(uint64_t &word);
+   // Moves the unread bytes to the front of the buffer and reads more after them
+   bool fill();
+
+   int fd_;
+   std::string path_;
+   std::vector<char> buffer_;
+   size_t pos_;
+   size_t end_;
+   bool eof_;
+   bool failed_;
+   int nLinks_;
+   uint64_t nFrames_;
+};
+
+// Bytes of the text of a frame of nLinks links whose first cycle has count wordCnt
+size_t textFrameSize(int nLinks, uint32_t wordCnt);
+
+// Formats the text of one frame (textFrameSize bytes) at out, wordCnt being the
+// count of its first cycle, with the layout of algo_unpacked_tb.cpp: per cycle
+// "0x%04x   ", then "0x%016x    " per link, then a newline; returns the end
+char *formatTextFrame(char *out, const ap_uint<192> *link, int nLinks, uint32_t wordCnt);
+
+/*
+ * Text vector output: the frames are formatted into a buffer of blockSize bytes
+ * (with a table of the hex digit pairs), which is written out whenever the next
+ * frame does not fit.
+ */
+class TextVectorWriter {
+public:
+   explicit TextVectorWriter(size_t blockSize = 1 << 20);
+   ~TextVectorWriter() { close(); }
+   TextVectorWriter(const TextVectorWriter &) = delete;
+   TextVectorWriter &operator=(const TextVectorWriter &) = delete;
+
+   // Creates path and writes the header of nLinks links; prints the error and returns false otherwise
+   bool open(const std::string &path, int nLinks);
+   // Frame whose first cycle has count wordCnt
+   void write(const ap_uint<192> *link, uint32_t wordCnt);
+   // False if a write failed (reported)
+   bool close();
+
+private:
+   void flush();
+
+   int fd_;
+   std::string path_;
+   std::vector<char> buffer_;
+   size_t end_;
+   int nLinks_;
+   bool failed_;
+};
+
+/*
+ * Text vector output written at precomputed offsets, so that the workers can write
+ * the frames of their chunks themselves, in any order. The size of each frame
+ * follows from its link count and word counts, so layout() gives every frame of a
+ * block its place after those of the previous blocks; write() then formats frames
+ * of the block into a buffer of the calling thread and puts them in place with
+ * one pwrite.
+ */
+class OffsetTextWriter {
+public:
+   OffsetTextWriter() : fd_(-1), nLinks_(0), end_(0), failed_(false) {}
+   ~OffsetTextWriter() { close(); }
+   OffsetTextWriter(const OffsetTextWriter &) = delete;
+   OffsetTextWriter &operator=(const OffsetTextWriter &) = delete;
+
+   // Creates path and writes the header of nLinks links; prints the error and returns false otherwise
+   bool open(const std::string &path, int nLinks);
+   // Places the next n frames, whose first cycles have counts wordCnt[0 ... n - 1]
+   void layout(const uint32_t *wordCnt, size_t n);
+   // Writes frames begin ... end - 1 of the last layout, the links of frame i at
+   // link + (i - begin) * stride; thread safe on disjoint frames
+   void write(const ap_uint<192> *link, size_t stride, size_t begin, size_t end);
+   // False if a write failed (reported)
+   bool close();
+
+private:
+   int fd_;
+   std::string path_;
+   int nLinks_;
+   uint64_t end_;                   // end of the frames placed so far
+   std::vector<uint64_t> offset_;   // of the frames of the last layout, and its end
+   std::vector<uint32_t> wordCnt_;
+   std::atomic<bool> failed_;
+};
+
+/*
+ * Read only view of a binary vector file mapped in memory (private, so that the
+ * frames handed out as modifiable links never reach the file).
+ */
+class MappedVectorFile {
+public:
+   MappedVectorFile() : data_(0), size_(0), header_(0) {}
+   ~MappedVectorFile() { close(); }
+   MappedVectorFile(const MappedVectorFile &) = delete;
+   MappedVectorFile &operator=(const MappedVectorFile &) = delete;
+
+   // Maps path and checks its header and size; prints the error and returns false otherwise
+   bool open(const std::string &path);
+   void close();
+
+   uint32_t nLinks() const { return header_->nLinks; }
+   uint64_t nFrames() const { return header_->nFrames; }
+   // Count of the last cycle of frame f, as given by TextVectorReader
+   uint32_t wordCnt(uint64_t f) const { return header_->firstWordCnt + NCyclesPerFrame * f + NCyclesPerFrame - 1; }
+
+   // Links of frames first ... first + n - 1: in place with the native link words,
+   // otherwise copied to scratch
+   ap_uint<192> *frames(uint64_t first, size_t n, std::vector<ap_uint<192> > &scratch) const;
+
+private:
+   const uint64_t *words(uint64_t f) const {
+      return (const uint64_t *) (data_ + sizeof(VectorFileHeader)) + f * nLinks() * NCyclesPerFrame;
+   }
+
+   char *data_;
+   size_t size_;
+   const VectorFileHeader *header_;
+};
+
+// Writes a binary vector file frame by frame; close() fills in the frame count
+class VectorFileWriter {
+public:
+   VectorFileWriter() : nLinks_(0), nFrames_(0) {}
+
+   bool open(const std::string &path, uint32_t nLinks, uint32_t firstWordCnt);
+   void write(const ap_uint<192> *link);
+   // False if a write failed
+   bool close();
+
+private:
+   std::ofstream ofs_;
+   std::string path_;
+   VectorFileHeader header_;
+   uint32_t nLinks_;
+   uint64_t nFrames_;
+   std::vector<uint64_t> words_;
+};
+
+// Text vector -> binary vector, or binary -> text if in is a binary vector file;
+// prints the error and returns false on failure
+bool convertVectorFile(const std::string &in, const std::string &out);
+
+#endif
@@ -0,0 +1,114 @@
+#include "ThreadPool.hh"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+ThreadPool::ThreadPool(unsigned nThreads, bool pinThreads)
+   : nThreads_(nThreads), queued_(0), stop_(false) {
+   unsigned nCores = std::thread::hardware_concurrency();
+   if (nCores == 0) nCores = 1;
+   if (nThreads_ == 0) nThreads_ = nCores;
+   if (nThreads_ < 2) return;
+
+   for (unsigned i = 0; i < nThreads_; i++)
+      queues_.emplace_back(new Queue);
+   for (unsigned i = 0; i < nThreads_; i++) {
+      workers_.emplace_back(&ThreadPool::workerLoop, this, i);
+#ifdef __linux__
+      if (pinThreads) {
+	 cpu_set_t cpus;
+	 CPU_ZERO(&cpus);
+	 CPU_SET(i % nCores, &cpus);
+	 pthread_setaffinity_np(workers_.back().native_handle(), sizeof(cpus), &cpus);
+      }
+#else
+      (void) pinThreads;
+#endif
+   }
+}
+
+ThreadPool::~ThreadPool() {
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+   }
+   wake_.notify_all();
+   for (size_t i = 0; i < workers_.size(); i++)
+      workers_[i].join();
+}
+
+void ThreadPool::push(unsigned worker, Task task) {
+   {
+      std::lock_guard<std::mutex> lock(queues_[worker]->mutex);
+      queues_[worker]->tasks.push_back(std::move(task));
+   }
+   queued_++;
+}
+
+bool ThreadPool::pop(unsigned worker, Task &task) {
+   // Own deque first (front), then steal from the back of the others
+   for (unsigned i = 0; i < nThreads_; i++) {
+      unsigned victim = (worker + i) % nThreads_;
+      Queue &q = *queues_[victim];
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (q.tasks.empty()) continue;
+      if (i == 0) {
+	 task = std::move(q.tasks.front());
+	 q.tasks.pop_front();
+      }
+      else {
+	 task = std::move(q.tasks.back());
+	 q.tasks.pop_back();
+      }
+      queued_--;
+      return true;
+   }
+   return false;
+}
+
+void ThreadPool::workerLoop(unsigned worker) {
+   Task task;
+   while (true) {
+      if (pop(worker, task)) {
+	 task();
+	 continue;
+      }
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+      if (stop_ && queued_ == 0) return;
+   }
+}
+
+void ThreadPool::parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)> &fn) {
+   if (grain == 0) grain = 1;
+   if (workers_.empty()) {
+      for (size_t begin = 0; begin < n; begin += grain)
+	 fn(begin, begin + grain < n ? begin + grain : n);
+      return;
+   }
+
+   size_t nChunks = (n + grain - 1) / grain;
+   size_t remaining = nChunks;
+   std::mutex doneMutex;
+   std::condition_variable done;
+
+   for (size_t chunk = 0; chunk < nChunks; chunk++) {
+      size_t begin = chunk * grain;
+      size_t end = begin + grain < n ? begin + grain : n;
+      push(chunk % nThreads_, [&, begin, end] {
+	 fn(begin, end);
+	 // Decrement under the lock: the caller may return as soon as it sees zero
+	 std::lock_guard<std::mutex> lock(doneMutex);
+	 if (--remaining == 0) done.notify_all();
+      });
+   }
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+   }
+   wake_.notify_all();
+
+   std::unique_lock<std::mutex> lock(doneMutex);
+   done.wait(lock, [&] { return remaining == 0; });
+}
@@ -0,0 +1,56 @@
+#ifndef ThreadPool_hh
+#define ThreadPool_hh
+
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Work-stealing thread pool for the emulator.
+ *
+ * Every worker owns a task deque; parallelFor deals chunks out round-robin,
+ * workers take from the front of their own deque and steal from the back of
+ * the others once it runs dry. Workers can optionally be pinned to cores.
+ * With fewer than two threads everything runs inline in the caller.
+ */
+class ThreadPool {
+public:
+   typedef std::function<void()> Task;
+
+   // nThreads = 0 uses std::thread::hardware_concurrency()
+   explicit ThreadPool(unsigned nThreads = 0, bool pinThreads = false);
+   ~ThreadPool();
+
+   unsigned size() const { return nThreads_; }
+
+   // Calls fn(begin, end) on chunks of at most grain indices covering [0, n)
+   // and returns once all chunks are done
+   void parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)> &fn);
+
+private:
+   struct Queue {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+   };
+
+   void push(unsigned worker, Task task);
+   bool pop(unsigned worker, Task &task);
+   void workerLoop(unsigned worker);
+
+   unsigned nThreads_;
+   std::vector<std::unique_ptr<Queue> > queues_;
+   std::vector<std::thread> workers_;
+   std::mutex mutex_;
+   std::condition_variable wake_;
+   std::atomic<size_t> queued_;
+   bool stop_;
+};
+
+#endif
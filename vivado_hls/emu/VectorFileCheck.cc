@@ -0,0 +1,339 @@
+#include <stdio.h>
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "VectorFileCheck.hh"
+#include "TestVector.hh"
+#include "ThreadPool.hh"
+#include "OutputComparator.hh"
+#include "LinkFormat.hh"
+
+using namespace std;
+
+namespace {
+
+bool readFile(const string &path, string &contents) {
+   ifstream ifs(path.c_str(), ios::binary);
+   contents.assign(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+   return ifs.is_open();
+}
+
+// The iostream parsing of algo_unpacked_tb.cpp, the reference of TextVectorReader
+int legacyReadHeader(istream &is) {
+   int nLinks = 0;
+   string token;
+   while (is >> token) {
+      if (token.compare("#BeginData") == 0)
+	 break;
+      if (token.compare(0, 5, "LINK_") == 0)
+	 nLinks++;
+   }
+   return nLinks;
+}
+
+bool legacyReadFrame(istream &is, ap_uint<192> *link, int nLinks, uint32_t &wordCnt) {
+   for (int cyc = 0; cyc < NCyclesPerFrame; cyc++) {
+      is >> hex >> wordCnt;
+      if (is.eof())
+	 return false;
+      for (int l = 0; l < nLinks; l++) {
+	 ap_uint<64> tmp;
+	 is >> hex >> tmp;
+	 link[l].range(64 * cyc + 63, 64 * cyc) = tmp;
+	 if (is.eof())
+	    return false;
+      }
+   }
+   return true;
+}
+
+// The iostream output of algo_unpacked_tb.cpp, the reference of TextVectorWriter
+void legacyWriteFrame(ostream &os, const ap_uint<192> *link, int nLinks, uint32_t wordCnt) {
+   for (int cyc = 0; cyc < NCyclesPerFrame; cyc++) {
+      os << "0x" << setfill('0') << setw(4) << hex << wordCnt++ << "   ";
+      for (int l = 0; l < nLinks; l++)
+	 os << "0x" << setfill('0') << setw(16) << hex << ap_uint<64>(link[l].range(64 * cyc + 63, 64 * cyc)).to_int64() << "    ";
+      os << "\n";
+   }
+}
+
+const int NLinks = 48;
+const int NFrames = 300;
+
+// Random frames
+void setLinks(vector<ap_uint<192> > &link) {
+   uint64_t x = 0x9E3779B97F4A7C15ull;
+   link.resize(NFrames * NLinks);
+   for (size_t i = 0; i < link.size(); i++) {
+      for (int cyc = 0; cyc < NCyclesPerFrame; cyc++) {
+	 x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+	 link[i].range(64 * cyc + 63, 64 * cyc) = x >> (x & 63);
+      }
+   }
+}
+
+// TextVectorWriter with blocks of blockSize against legacyWriteFrame, on random
+// frames with word counts crossing 0x10000 (wider than setw(4))
+bool writerSameAsLegacy(const string &path, size_t blockSize) {
+   vector<ap_uint<192> > link;
+   setLinks(link);
+   ostringstream expected;
+   expected << textHeader(NLinks);
+   TextVectorWriter writer(blockSize);
+   if (!writer.open(path, NLinks))
+      return false;
+   uint32_t firstWordCnt = 0x10000 - 3 * NFrames / 2;
+   for (int f = 0; f < NFrames; f++) {
+      legacyWriteFrame(expected, &link[f * NLinks], NLinks, firstWordCnt + 3 * f);
+      writer.write(&link[f * NLinks], firstWordCnt + 3 * f);
+   }
+   string written;
+   if (!writer.close() || !readFile(path, written) || written != expected.str()) {
+      cout << "TextVectorWriter (blocks of " << blockSize << ") differs from the iostream output" << endl;
+      return false;
+   }
+   cout << "TextVectorWriter (blocks of " << blockSize << ") same as the iostream output on " << NFrames << " random frames" << endl;
+   return true;
+}
+
+// OffsetTextWriter fed by the chunks of a thread pool, in two blocks, against
+// TextVectorWriter (whose output is path + ".ordered")
+bool offsetWriterSameAsOrdered(const string &path, unsigned nThreads, size_t grain) {
+   vector<ap_uint<192> > link;
+   setLinks(link);
+   vector<uint32_t> wordCnt(NFrames);
+   for (int f = 0; f < NFrames; f++)
+      wordCnt[f] = 0x10000 - 3 * NFrames / 2 + 3 * f;
+
+   string orderedPath(path + ".ordered");
+   TextVectorWriter ordered;
+   OffsetTextWriter writer;
+   if (!ordered.open(orderedPath, NLinks) || !writer.open(path, NLinks))
+      return false;
+   for (int f = 0; f < NFrames; f++)
+      ordered.write(&link[f * NLinks], wordCnt[f]);
+   ThreadPool pool(nThreads);
+   const size_t NFirst = NFrames / 3;
+   size_t blocks[3] = { 0, NFirst, NFrames };
+   for (int b = 0; b < 2; b++) {
+      size_t first = blocks[b], n = blocks[b + 1] - blocks[b];
+      writer.layout(&wordCnt[first], n);
+      pool.parallelFor(n, grain, [&](size_t begin, size_t end) {
+	 writer.write(&link[(first + begin) * NLinks], NLinks, begin, end);
+      });
+   }
+   string expected, written;
+   bool same = ordered.close() && writer.close() && readFile(orderedPath, expected) && readFile(path, written) &&
+      written == expected;
+   remove(orderedPath.c_str());
+   if (!same) {
+      cout << "OffsetTextWriter on " << nThreads << " threads differs from TextVectorWriter" << endl;
+      return false;
+   }
+   cout << "OffsetTextWriter on " << nThreads << " threads (chunks of " << grain << ") same as TextVectorWriter on "
+      << NFrames << " random frames" << endl;
+   return true;
+}
+
+// OutputComparator against a reference of random frames written with a latency of
+// two frames: the same frames match, and a changed cluster field, changed bits
+// outside the cluster words and a missing last event are found
+bool comparatorFindsMismatches(const string &path) {
+   const unsigned Latency = 2;
+   vector<ap_uint<192> > link;
+   setLinks(link);
+   TextVectorWriter writer;
+   if (!writer.open(path, NLinks))
+      return false;
+   for (unsigned f = 0; f < Latency; f++)
+      writer.write(&link[0], 3 * f);
+   for (int f = 0; f < NFrames; f++)
+      writer.write(&link[f * NLinks], 3 * (Latency + f));
+   if (!writer.close())
+      return false;
+
+   // Frame 10: ET of cluster 1 of link 5 (and its copies); frame 20: bit 3 of link 7
+   vector<ap_uint<192> > changed(link);
+   int etLo = FirstClusterBit + NClusterWordBits + ClusterWordLayout[ETField].lo;
+   for (int l = 5 % NDistinctOutputLinks; l < NLinks; l += NDistinctOutputLinks)
+      changed[10 * NLinks + l].range(etLo + 15, etLo) = changed[10 * NLinks + l].range(etLo + 15, etLo) ^ 1;
+   changed[20 * NLinks + 7].range(3, 3) = changed[20 * NLinks + 7].range(3, 3) ^ 1;
+
+   OutputComparator same(0), different(0), missing(0);
+   cout << "(the mismatches below are expected)" << endl;
+   bool ok = same.open("same", path, NLinks, Latency) && different.open("different", path, NLinks, Latency) &&
+      missing.open("missing", path, NLinks, Latency);
+   ok = ok && same.compare(&link[0], NLinks, 100) && same.compare(&link[100 * NLinks], NLinks, NFrames - 100) && same.finish();
+   ok = ok && !different.compare(&changed[0], NLinks, NFrames) && !different.finish() && different.nEventsDiffer() == 2;
+   ok = ok && missing.compare(&link[0], NLinks, NFrames - 1) && !missing.finish();
+   if (!ok) {
+      cout << "OutputComparator does not find the mismatches" << endl;
+      return false;
+   }
+   cout << "OutputComparator finds the changed cluster field, the changed bits and the missing event" << endl;
+   return true;
+}
+
+// Frames of a text vector, parsed by legacyReadFrame
+struct Frames {
+   int nLinks;
+   vector<ap_uint<192> > link;
+   vector<uint32_t> wordCnt;
+};
+
+void legacyRead(const string &textVector, Frames &frames) {
+   ifstream ifs(textVector.c_str());
+   frames.nLinks = legacyReadHeader(ifs);
+   vector<ap_uint<192> > link(frames.nLinks);
+   uint32_t wordCnt;
+   while (legacyReadFrame(ifs, &link[0], frames.nLinks, wordCnt)) {
+      frames.link.insert(frames.link.end(), link.begin(), link.end());
+      frames.wordCnt.push_back(wordCnt);
+   }
+}
+
+// TextVectorReader with blocks of blockSize, reading batches of nBatch frames, against legacyRead
+bool readerSameAsLegacy(const string &textVector, size_t blockSize, size_t nBatch) {
+   Frames expected;
+   legacyRead(textVector, expected);
+   TextVectorReader reader(blockSize);
+   if (!reader.open(textVector))
+      return false;
+   size_t nFrames = expected.wordCnt.size();
+   vector<ap_uint<192> > link(nBatch * reader.nLinks());
+   vector<uint32_t> wordCnt(nBatch);
+   size_t f = 0, n;
+   bool same = reader.nLinks() == expected.nLinks;
+   while (same && (n = reader.read(&link[0], nBatch, &wordCnt[0])) > 0) {
+      same = f + n <= nFrames;
+      for (size_t i = 0; same && i < n; i++, f++) {
+	 same = wordCnt[i] == expected.wordCnt[f] &&
+	    equal(link.begin() + i * expected.nLinks, link.begin() + (i + 1) * expected.nLinks,
+		  expected.link.begin() + f * expected.nLinks);
+      }
+   }
+   if (!same || f != nFrames || reader.failed()) {
+      cout << "TextVectorReader (blocks of " << blockSize << ") differs from the iostream parsing of " << textVector
+	 << " at frame " << f << endl;
+      return false;
+   }
+   cout << "TextVectorReader (blocks of " << blockSize << ", batches of " << nBatch << ") same as the iostream parsing on the "
+      << nFrames << " frames of " << textVector << endl;
+   return true;
+}
+
+// Text vector with the freedom of the format: upper case, short or unprefixed words,
+// tabs and CRLF, and a last frame cut short
+void writeUnusualText(const string &path) {
+   ofstream ofs(path.c_str(), ios::binary);
+   ofs << textHeader(3);
+   uint64_t x = 0x9E3779B97F4A7C15ull;
+   for (int line = 0; line < 3 * 50 + 2; line++) {
+      ofs << "0x" << hex << line << (line % 7 == 0 ? "\r\n" : "\t ");
+      for (int l = 0; l < 3; l++) {
+	 x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+	 int style = (line + l) % 4;
+	 if (style == 0) ofs << "0x" << hex << (x >> (x & 63));
+	 else if (style == 1) ofs << "0X" << uppercase << hex << x << nouppercase;
+	 else if (style == 2) ofs << hex << (x & 0xFFFF);
+	 else ofs << "0x" << hex << x;
+	 ofs << (l == 2 ? (line % 5 == 0 ? "\r\n" : "\n") : "   ");
+      }
+   }
+}
+
+bool malformedRefused(const string &path) {
+   ofstream(path.c_str(), ios::binary) << textHeader(1) << "0x0000 0x00000000000012G4\n";
+   TextVectorReader reader;
+   ap_uint<192> link;
+   uint32_t wordCnt;
+   cout << "(the error below is expected)" << endl;
+   if (!reader.open(path) || reader.read(&link, 1, &wordCnt) != 0 || !reader.failed()) {
+      cout << "Malformed text vector not refused" << endl;
+      return false;
+   }
+   cout << "Malformed text vector refused" << endl;
+   return true;
+}
+
+// Mapped frames and word counts against those read from the text
+bool sameFramesAsText(const string &textVector, const string &binaryVector) {
+   Frames expected;
+   legacyRead(textVector, expected);
+   MappedVectorFile vf;
+   if (!vf.open(binaryVector))
+      return false;
+   if (vf.nLinks() != (uint32_t) expected.nLinks || vf.nFrames() != expected.wordCnt.size()) {
+      cout << binaryVector << ": " << vf.nFrames() << " frames of " << vf.nLinks() << " links, the text vector has "
+	 << expected.wordCnt.size() << " of " << expected.nLinks << endl;
+      return false;
+   }
+   vector<ap_uint<192> > scratch;
+   for (uint64_t f = 0; f < vf.nFrames(); f++) {
+      const ap_uint<192> *mapped = vf.frames(f, 1, scratch);
+      if (!equal(mapped, mapped + expected.nLinks, &expected.link[f * expected.nLinks]) ||
+	    vf.wordCnt(f) != expected.wordCnt[f]) {
+	 cout << binaryVector << ": frame " << f << " differs from the text vector" << endl;
+	 return false;
+      }
+   }
+   cout << "Binary vector gives the " << vf.nFrames() << " frames of " << textVector << endl;
+   return true;
+}
+
+bool truncatedRefused(const string &binaryVector, const string &truncated) {
+   string contents;
+   readFile(binaryVector, contents);
+   ofstream(truncated.c_str(), ios::binary).write(contents.data(), contents.size() - 8);
+   MappedVectorFile vf;
+   cout << "(the error below is expected)" << endl;
+   if (vf.open(truncated)) {
+      cout << "Truncated binary vector not refused" << endl;
+      return false;
+   }
+   cout << "Truncated binary vector refused" << endl;
+   return true;
+}
+
+}
+
+bool checkVectorFiles(const string &textVector) {
+   string base(textVector.substr(textVector.find_last_of('/') + 1));
+   string binaryVector(base + ".check.bin"), backToText(base + ".check.txt"), truncated(base + ".check.truncated.bin");
+   string unusual(base + ".check.unusual.txt"), malformed(base + ".check.malformed.txt"), written(base + ".check.written.txt");
+
+   bool ok = readerSameAsLegacy(textVector, 1 << 20, 4096) && readerSameAsLegacy(textVector, 4096, 7);
+   writeUnusualText(unusual);
+   ok = ok && readerSameAsLegacy(unusual, 1 << 20, 1) && readerSameAsLegacy(unusual, 1500, 3) && malformedRefused(malformed);
+   ok = ok && writerSameAsLegacy(written, 1 << 20) && writerSameAsLegacy(written, 1000) &&
+      offsetWriterSameAsOrdered(written, 4, 7) && offsetWriterSameAsOrdered(written, 1, 1000) &&
+      comparatorFindsMismatches(written);
+   if (!ok)
+      return false;
+
+   if (!convertVectorFile(textVector, binaryVector) || !sameFramesAsText(textVector, binaryVector) ||
+	 !convertVectorFile(binaryVector, backToText))
+      return false;
+   string original, converted;
+   if (!readFile(textVector, original) || !readFile(backToText, converted) || original != converted) {
+      cout << backToText << " differs from " << textVector << endl;
+      return false;
+   }
+   cout << "Binary vector converted back to text same as " << textVector << endl;
+   if (!truncatedRefused(binaryVector, truncated))
+      return false;
+
+   remove(binaryVector.c_str());
+   remove(backToText.c_str());
+   remove(truncated.c_str());
+   remove(unusual.c_str());
+   remove(malformed.c_str());
+   remove(written.c_str());
+   return true;
+}
@@ -0,0 +1,27 @@
+#ifndef VectorFileCheck_hh
+#define VectorFileCheck_hh
+
+#include <string>
+
+/*
+ * Self checks of the binary test vector format of TestVector.hh
+ * and of the text vector parser (rct_emu --check-vectors <text vector>), writing
+ * their files to the current directory:
+ *  - TextVectorReader against the iostream parsing of algo_unpacked_tb.cpp on the
+ *    text vector and on one with upper case, short and unprefixed words, tabs, CRLF
+ *    and a last frame cut short, with blocks small enough to split tokens;
+ *  - a malformed word is refused;
+ *  - TextVectorWriter against the iostream output of algo_unpacked_tb.cpp, byte
+ *    for byte, with word counts wider than 4 digits and blocks smaller than a frame;
+ *  - OffsetTextWriter written by the chunks of a thread pool against TextVectorWriter;
+ *  - OutputComparator with a latency finds a changed cluster field, changed bits
+ *    outside the cluster words and a missing event, and nothing on the same frames;
+ *  - the text vector converted to binary and mapped gives the frames and word
+ *    counts read from the text;
+ *  - converted back to text it is the same file, byte for byte;
+ *  - a truncated binary vector is refused.
+ * Prints a line per check; false if any failed.
+ */
+bool checkVectorFiles(const std::string &textVector);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef algo_unpacked_h
+#define algo_unpacked_h
+
+// Interface header for the standalone (non Vivado HLS) emulator build.
+// It mirrors algo_unpacked.h from APx_Gen0_Algo/VivadoHls/null_algo_unpacked,
+// which remains the reference for the HLS project (see sources.tcl).
+// Unless RCT_EMU_AP_INT is defined, ap_uint<W> is the native BitVector<W>.
+
+#ifdef RCT_EMU_AP_INT
+#include <ap_int.h>
+#else
+#include "BitVector.hh"
+template<int W> using ap_uint = BitVector<W>;
+#endif
+
+#define N_CH_IN 48
+#define N_CH_OUT 48
+
+void algo_unpacked(ap_uint<192> link_in[N_CH_IN], ap_uint<192> link_out[N_CH_OUT]);
+
+#endif
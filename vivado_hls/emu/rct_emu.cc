@@ -0,0 +1,442 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <filesystem>
+
+#include "algo_unpacked.h"
+#include "EventRunner.hh"
+#include "FrameCache.hh"
+#include "AlgoContext.hh"
+#include "Detector.hh"
+#include "SorterCheck.hh"
+#include "LaneCheck.hh"
+#include "LinkFormatCheck.hh"
+#include "BatchCheck.hh"
+#include "CardCheck.hh"
+#include "TestVector.hh"
+#include "VectorFileCheck.hh"
+#include "OutputComparator.hh"
+
+using namespace std;
+
+/*
+ * rct_emu: standalone driver for algo_unpacked.
+ *
+ * Does the same job as algo_unpacked_tb.cpp under "vivado_hls -f run_hls.tcl csim=1",
+ * but is built natively (see CMakeLists.txt) so that it can be iterated on quickly:
+ * reads <data-dir>/<tv>_inp.txt (or the binary <tv>_inp.bin, see TestVector.hh),
+ * writes <out-dir>/<tv>_out.txt and checks it against <data-dir>/<tv>_out_ref.txt
+ * as it goes (OutputComparator). With --all and --jobs it runs the whole data
+ * directory as a regression, several vectors at a time.
+ */
+
+#ifndef RCT_DATA_DIR
+#define RCT_DATA_DIR "data"
+#endif
+
+static void usage(const char *prog) {
+   cerr << "Usage: " << prog << " [options] --tv <name> [--tv <name> ...] | --all" << endl
+	<< "  --tv <name>        test vector <name>_inp.txt / <name>_out_ref.txt (repeatable)" << endl
+	<< "  --all              every test vector of the data directory with an input and a reference output" << endl
+	<< "  --jobs <n>         test vectors run at once, sharing the threads, 0 = one per core (default: 1;" << endl
+	<< "                     not in full-barrel mode)" << endl
+	<< "  --data-dir <dir>   directory holding the test vectors (default: " << RCT_DATA_DIR << ")" << endl
+	<< "  --out-dir <dir>    directory for <name>_out.txt (default: .)" << endl
+	<< "  --binary           read the binary input vectors <name>_inp.bin instead of <name>_inp.txt" << endl
+	<< "  --batch <n>        events per thread chunk and getClustersInCards batch, 0 calls algo_unpacked per event (default: 256)" << endl
+	<< "  --threads <n>      worker threads, 0 = one per core (default: 1)" << endl
+	<< "  --pin              pin worker threads to cores" << endl
+	<< "  --cache <n>        reuse the output of repeated input frames, keeping up to n frames (default: 0, off;" << endl
+	<< "                     not in full-barrel mode)" << endl
+	<< "  --latency <n>      compare output event f with reference frame f + n (default: 0)" << endl
+	<< "  --max-mismatches <n> report the first mismatch of at most n link fields (default: 10)" << endl
+	<< "  --stop-early       stop a test vector at the first block of events with a mismatch" << endl
+	<< "  --parallel-output  the workers write the output of their chunks in place (pwrite at precomputed offsets)" << endl
+	<< "                     instead of the main thread in event order (not in full-barrel mode)" << endl
+	<< "  --incremental      only recompute the regions whose crystals changed since the previous event of the chunk" << endl
+	<< "  --noise <et>       batched mode: process towers whose crystals are all at or below et as empty towers" << endl
+	<< "                     (zero suppression, which changes the output; default: 0)" << endl
+	<< "  --dump             print the unpacked crystals and packed clusters of the first event" << endl
+	<< "  --full-barrel      run every event through all " << NRCTCards << " RCT cards concurrently" << endl
+	<< "  --link-map <map>   full-barrel detector link to card link map: identity, replicate or a file (default: identity)" << endl
+	<< "  --card <n>         full-barrel: only write the output links of card n (default: all cards)" << endl
+	<< "  --check-sorters    check the sorting networks against the legacy bitonic sorts and exit" << endl
+	<< "  --check-lanes      check the vector lane kernels against the scalar code and exit" << endl
+	<< "  --check-links      check the output link packing against the legacy packer and exit" << endl
+	<< "  --check-batch      check the batched and sparse card processing against getClustersInCard and exit" << endl
+	<< "  --check-cards      check the emulator variants of the card steps against the HLS code and exit" << endl
+	<< "  --check-vectors <f> check the binary vector format on the text vector f and exit" << endl
+	<< "  --convert <in> <out> convert a text vector to the binary format, or back if in is binary, and exit" << endl
+	<< "  -h, --help         this message" << endl;
+}
+
+struct EmuOptions {
+   string dataDir;
+   string outDir;
+   bool binary;
+   unsigned latency;      // output event f is compared with reference frame f + latency
+   size_t maxMismatches;  // reported
+   bool stopEarly;
+   bool parallelOutput;
+   bool dump;
+   bool fullBarrel;
+   int card;  // full barrel: card whose output links are written, -1 for all
+};
+
+struct TestVectorResult {
+   bool passed;       // output same as the reference, no card failed
+   uint64_t nEvents;
+   double seconds;
+};
+
+// Runs one test vector, its messages going to log; cache, if given, for its hit counts
+static TestVectorResult runTestVector(const EmuOptions &opt, const string &tv, EventRunner &runner,
+      DetectorEmulator &detector, uint32_t nDetectorLinks, const FrameCache *cache, ostream &log) {
+   TestVectorResult result = { false, 0, 0. };
+
+   string ifname(opt.dataDir + "/" + tv + (opt.binary ? "_inp.bin" : "_inp.txt")); // input test vector
+   string ofname(opt.outDir + "/" + tv + "_out.txt");      // output test vector
+   string orfname(opt.dataDir + "/" + tv + "_out_ref.txt"); // reference output vector
+
+   // Binary vectors are mapped and their frames used in place, text ones parsed
+   MappedVectorFile vf;
+   TextVectorReader reader;
+   int nLinksIn = 0;
+   if (opt.binary) {
+      if (!vf.open(ifname))
+	 return result;
+      nLinksIn = vf.nLinks();
+   }
+   else {
+      if (!reader.open(ifname, N_CH_IN))
+	 return result;
+      nLinksIn = reader.nLinks();
+   }
+
+   int nLinksOut = N_CH_OUT;
+   if (!opt.fullBarrel && nLinksIn != N_CH_IN) {
+      cerr << ifname << ": " << nLinksIn << " links, a single card needs " << N_CH_IN << " (use --full-barrel?)" << endl;
+      return result;
+   }
+   if (opt.fullBarrel) {
+      if ((uint32_t) nLinksIn < nDetectorLinks) {
+	 cerr << ifname << ": " << nLinksIn << " links, the link map needs " << nDetectorLinks << endl;
+	 return result;
+      }
+      if (opt.card < 0) nLinksOut = NRCTCards * N_CH_OUT;
+   }
+
+   // Output in order from here, or by the workers at the place of their frames
+   bool parallelOutput = opt.parallelOutput && !opt.fullBarrel;
+   TextVectorWriter writer;
+   OffsetTextWriter offsetWriter;
+   if (!(parallelOutput ? offsetWriter.open(ofname, nLinksOut) : writer.open(ofname, nLinksOut)))
+      return result;
+   OutputComparator comparator(opt.maxMismatches, log);
+   if (!comparator.open(tv, orfname, nLinksOut, opt.latency))
+      return result;
+
+   auto start = chrono::steady_clock::now();
+   FrameCache::Stats cacheStart = {};
+   if (cache) cacheStart = cache->stats();
+   uint64_t nRegionsStart = runner.nRegions(), nRecomputedStart = runner.nRegionsRecomputed();
+   uint64_t nEvents = 0;
+   bool success = true;
+
+   // Frames are read in blocks that keep every worker busy with several chunks;
+   // in full-barrel mode the cards of each event already fill the workers
+   size_t nBlock = opt.fullBarrel ? 64 : 4096 * runner.nThreads();
+   size_t nLinksPerEventOut = opt.fullBarrel ? NRCTCards * N_CH_OUT : N_CH_OUT;
+   vector<ap_uint<192> > link_in(nBlock * nLinksIn);
+   vector<ap_uint<192> > link_out(nBlock * nLinksPerEventOut);
+   vector<uint32_t> wordCnt(nBlock);
+   ClusterColumns clusters;
+
+   size_t firstLink = (opt.fullBarrel && opt.card > 0) ? opt.card * N_CH_OUT : 0;
+   bool more = true, stoppedEarly = false;
+   while (more) {
+      size_t n = 0;
+      ap_uint<192> *in = &link_in[0];
+      if (opt.binary) {
+	 n = (size_t) min<uint64_t>(nBlock, vf.nFrames() - nEvents);
+	 in = vf.frames(nEvents, n, link_in);
+	 for (size_t i = 0; i < n; i++)
+	    wordCnt[i] = vf.wordCnt(nEvents + i);
+	 more = nEvents + n < vf.nFrames();
+      }
+      else {
+	 n = reader.read(&link_in[0], nBlock, &wordCnt[0]);
+	 more = n == nBlock;
+	 success &= !reader.failed();
+      }
+      if (n == 0)
+	 break;
+      // Same two word latency as algo_unpacked_tb.cpp
+      for (size_t i = 0; i < n; i++)
+	 wordCnt[i] -= 2;
+
+      if (opt.dump && nEvents == 0 && !opt.fullBarrel) {
+	 AlgoContext ctx;
+	 ctx.dump = true;
+	 algo_unpacked_ctx(ctx, in, &link_out[0]);
+      }
+      if (opt.fullBarrel) {
+	 for (size_t i = 0; i < n; i++)
+	    success &= detector.processEvent(&in[i * nLinksIn], clusters, &link_out[i * nLinksPerEventOut]);
+      }
+      else if (parallelOutput) {
+	 offsetWriter.layout(&wordCnt[0], n);
+	 success &= runner.run(in, n, &link_out[0], [&](size_t begin, size_t end) {
+	    offsetWriter.write(&link_out[begin * N_CH_OUT], N_CH_OUT, begin, end);
+	 });
+      }
+      else {
+	 success &= runner.run(in, n, &link_out[0]);
+      }
+
+      if (!parallelOutput) {
+	 for (size_t i = 0; i < n; i++)
+	    writer.write(&link_out[i * nLinksPerEventOut + firstLink], wordCnt[i]);
+      }
+      nEvents += n;
+      if (!comparator.compare(&link_out[firstLink], nLinksPerEventOut, n) && opt.stopEarly) {
+	 log << tv << ": stopping at the first block with a mismatch, after " << nEvents << " events" << endl;
+	 stoppedEarly = true;
+	 break;
+      }
+   }
+   success &= parallelOutput ? offsetWriter.close() : writer.close();
+
+   double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+   log << tv << ": " << dec << nEvents << " events in " << fixed << setprecision(3) << seconds * 1e3 << " ms ("
+	<< setprecision(0) << (seconds > 0 ? nEvents / seconds : 0.) << " events/s)" << endl;
+   if (cache && !opt.fullBarrel) {
+      FrameCache::Stats s = cache->stats();
+      uint64_t lookups = s.lookups - cacheStart.lookups;
+      uint64_t hits = s.hits - cacheStart.hits;
+      uint64_t repeats = s.repeats - cacheStart.repeats;
+      log << tv << ": frame cache " << hits << " hits and " << repeats << " batch repeats in " << lookups << " frames ("
+	   << setprecision(1) << (lookups > 0 ? 100. * (hits + repeats) / lookups : 0.) << "% not processed), "
+	   << s.evictions - cacheStart.evictions
+	   << " evictions, " << cache->size() << " of " << cache->capacity() << " frames held" << endl;
+   }
+   if (runner.nRegions() > nRegionsStart) {
+      uint64_t nRegions = runner.nRegions() - nRegionsStart;
+      uint64_t nRecomputed = runner.nRegionsRecomputed() - nRecomputedStart;
+      log << tv << ": incremental: " << nRecomputed << " of " << nRegions << " regions recomputed ("
+	   << setprecision(1) << 100. * nRecomputed / nRegions << "%)" << endl;
+   }
+   if (!success)
+      cerr << tv << ": getClustersInCard failed" << endl;
+
+   result.nEvents = nEvents;
+   result.seconds = seconds;
+   if (!comparator.finish(stoppedEarly)) {
+      log << "*** " << tv << ": Output data verification. FAILED! ***" << endl;
+      return result;
+   }
+   log << "*** " << tv << ": Output data verification. PASSED ***" << endl;
+   result.passed = success;
+   return result;
+}
+
+// Names of the test vectors of dir with an input (text, or binary) and a reference output, sorted
+static vector<string> findTestVectors(const string &dir, bool binary) {
+   namespace fs = std::filesystem;
+   const string suffix(binary ? "_inp.bin" : "_inp.txt");
+   vector<string> names;
+   error_code ec;
+   for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+      string file = it->path().filename().string();
+      if (file.size() <= suffix.size() || file.compare(file.size() - suffix.size(), suffix.size(), suffix) != 0)
+	 continue;
+      string tv = file.substr(0, file.size() - suffix.size());
+      if (fs::is_regular_file(fs::path(dir) / (tv + "_out_ref.txt"), ec))
+	 names.push_back(tv);
+   }
+   if (ec)
+      cerr << dir << ": " << ec.message() << endl;
+   sort(names.begin(), names.end());
+   return names;
+}
+
+int main(int argc, char **argv) {
+
+   EmuOptions opt;
+   opt.dataDir = RCT_DATA_DIR;
+   opt.outDir = ".";
+   opt.binary = false;
+   opt.latency = 0;
+   opt.maxMismatches = 10;
+   opt.stopEarly = false;
+   opt.parallelOutput = false;
+   opt.dump = false;
+   opt.fullBarrel = false;
+   opt.card = -1;
+   string linkMapName("identity");
+   size_t batchSize = 256;
+   unsigned nThreads = 1;
+   bool pin = false;
+   bool incremental = false;
+   uint16_t noiseThreshold = 0;
+   size_t cacheSize = 0;
+   unsigned nJobs = 1;
+   bool allVectors = false;
+   vector<string> testVectors;
+
+   for (int i = 1; i < argc; i++) {
+      string arg(argv[i]);
+      if ((arg == "--tv" || arg == "--data-dir" || arg == "--out-dir" || arg == "--batch" || arg == "--threads" || arg == "--jobs" ||
+	    arg == "--cache" || arg == "--noise" || arg == "--link-map" || arg == "--card" ||
+	    arg == "--latency" || arg == "--max-mismatches" || arg == "--check-vectors") && i + 1 >= argc) {
+	 cerr << "Missing value for " << arg << endl;
+	 usage(argv[0]);
+	 return 2;
+      }
+      if (arg == "--tv") testVectors.push_back(argv[++i]);
+      else if (arg == "--data-dir") opt.dataDir = argv[++i];
+      else if (arg == "--out-dir") opt.outDir = argv[++i];
+      else if (arg == "--batch") batchSize = strtoul(argv[++i], 0, 0);
+      else if (arg == "--threads") nThreads = strtoul(argv[++i], 0, 0);
+      else if (arg == "--jobs") nJobs = strtoul(argv[++i], 0, 0);
+      else if (arg == "--all") allVectors = true;
+      else if (arg == "--pin") pin = true;
+      else if (arg == "--incremental") incremental = true;
+      else if (arg == "--cache") cacheSize = strtoul(argv[++i], 0, 0);
+      else if (arg == "--noise") noiseThreshold = strtoul(argv[++i], 0, 0);
+      else if (arg == "--binary") opt.binary = true;
+      else if (arg == "--latency") opt.latency = strtoul(argv[++i], 0, 0);
+      else if (arg == "--max-mismatches") opt.maxMismatches = strtoul(argv[++i], 0, 0);
+      else if (arg == "--stop-early") opt.stopEarly = true;
+      else if (arg == "--parallel-output") opt.parallelOutput = true;
+      else if (arg == "--dump") opt.dump = true;
+      else if (arg == "--full-barrel") opt.fullBarrel = true;
+      else if (arg == "--link-map") linkMapName = argv[++i];
+      else if (arg == "--card") opt.card = strtol(argv[++i], 0, 0);
+      else if (arg == "--check-sorters") return checkSorters() ? 0 : 1;
+      else if (arg == "--check-lanes") return checkLanes() ? 0 : 1;
+      else if (arg == "--check-links") return checkLinkFormat() ? 0 : 1;
+      else if (arg == "--check-batch") return checkBatch() ? 0 : 1;
+      else if (arg == "--check-cards") return checkCards() ? 0 : 1;
+      else if (arg == "--check-vectors") return checkVectorFiles(argv[++i]) ? 0 : 1;
+      else if (arg == "--convert") {
+	 if (i + 2 >= argc) {
+	    cerr << "Missing arguments for --convert" << endl;
+	    return 2;
+	 }
+	 i += 2;
+	 return convertVectorFile(argv[i - 1], argv[i]) ? 0 : 1;
+      }
+      else if (arg == "-h" || arg == "--help") {
+	 usage(argv[0]);
+	 return 0;
+      }
+      else {
+	 cerr << "Unknown option: " << arg << endl;
+	 usage(argv[0]);
+	 return 2;
+      }
+   }
+
+   if (allVectors) {
+      for (const string &tv : findTestVectors(opt.dataDir, opt.binary)) {
+	 if (find(testVectors.begin(), testVectors.end(), tv) == testVectors.end())
+	    testVectors.push_back(tv);
+      }
+      if (testVectors.empty()) {
+	 cerr << opt.dataDir << ": no test vectors" << endl;
+	 return 2;
+      }
+   }
+   if (testVectors.empty()) {
+      usage(argv[0]);
+      return 2;
+   }
+
+   if (opt.card >= (int) NRCTCards) {
+      cerr << "--card must be below " << NRCTCards << endl;
+      return 2;
+   }
+   LinkMap linkMap;
+   if (!linkMap.load(linkMapName))
+      return 2;
+
+   // Several vectors at a time: each job has its own runner on its share of the
+   // threads, and prints its messages once its vector is done
+   if (nJobs == 0) nJobs = thread::hardware_concurrency();
+   nJobs = min<size_t>(max(nJobs, 1u), testVectors.size());
+   bool concurrent = nJobs > 1 && !opt.fullBarrel && !opt.dump;
+   if (nThreads == 0) nThreads = thread::hardware_concurrency();
+   unsigned nJobThreads = max(nThreads / nJobs, 1u);
+
+   // Full-barrel mode parallelizes over the cards of each event, otherwise over events
+   unique_ptr<FrameCache> cache(cacheSize > 0 ? new FrameCache(cacheSize) : 0);
+   EventRunner::Mode mode = batchSize == 0 ? EventRunner::PerEvent :
+      incremental ? EventRunner::Incremental : EventRunner::Batched;
+   EventRunner runner(opt.fullBarrel || concurrent ? 1 : nThreads, pin, batchSize > 0 ? batchSize : 256, mode,
+	 noiseThreshold, cache.get());
+   ThreadPool cardPool(opt.fullBarrel ? nThreads : 1, pin);
+   DetectorEmulator detector(linkMap, cardPool);
+
+   auto start = chrono::steady_clock::now();
+   vector<TestVectorResult> results(testVectors.size());
+   if (concurrent) {
+      mutex logMutex;
+      ThreadPool jobPool(nJobs);
+      jobPool.parallelFor(testVectors.size(), 1, [&](size_t begin, size_t end) {
+	 for (size_t i = begin; i < end; i++) {
+	    EventRunner jobRunner(nJobThreads, pin, batchSize > 0 ? batchSize : 256, mode, noiseThreshold, cache.get());
+	    ostringstream log;
+	    // Cache hit counts are not per vector with the cache shared by the jobs
+	    results[i] = runTestVector(opt, testVectors[i], jobRunner, detector, linkMap.nDetectorLinks(), 0, log);
+	    lock_guard<mutex> lock(logMutex);
+	    cout << log.str() << flush;
+	 }
+      });
+   }
+   else {
+      for (size_t i = 0; i < testVectors.size(); i++)
+	 results[i] = runTestVector(opt, testVectors[i], runner, detector, linkMap.nDetectorLinks(), cache.get(), cout);
+   }
+   double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+   int nFailed = 0;
+   for (size_t i = 0; i < results.size(); i++) {
+      if (!results[i].passed) nFailed++;
+   }
+   if (testVectors.size() > 1) {
+      size_t width = 6;
+      uint64_t nEvents = 0;
+      for (size_t i = 0; i < testVectors.size(); i++) {
+	 width = max(width, testVectors[i].size());
+	 nEvents += results[i].nEvents;
+      }
+      cout << endl << left << setw(width) << "vector" << right << setw(12) << "events" << setw(12) << "ms"
+	   << setw(14) << "events/s" << "  result" << endl;
+      for (size_t i = 0; i < testVectors.size(); i++) {
+	 const TestVectorResult &r = results[i];
+	 cout << left << setw(width) << testVectors[i] << right << setw(12) << r.nEvents << fixed
+	      << setprecision(3) << setw(12) << r.seconds * 1e3 << setprecision(0) << setw(14)
+	      << (r.seconds > 0 ? r.nEvents / r.seconds : 0.) << "  " << (r.passed ? "PASSED" : "FAILED") << endl;
+      }
+      cout << testVectors.size() << " vectors, " << nEvents << " events in " << setprecision(3) << seconds * 1e3
+	   << " ms (" << (concurrent ? nJobs : 1) << " at a time): " << nFailed << " FAILED" << endl;
+      if (cache && concurrent) {
+	 FrameCache::Stats s = cache->stats();
+	 cout << "frame cache " << s.hits << " hits and " << s.repeats << " batch repeats in " << s.lookups << " frames" << endl;
+      }
+   }
+   return nFailed == 0 ? 0 : 1;
+}
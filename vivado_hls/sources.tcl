@@ -1,13 +1,20 @@
 ## Set the top level module
 set_top algo_unpacked
 ##
+## algo_unpacked.h comes from the APx_Gen0_Algo checkout (override with APX_ALGO_SRC)
+if {[info exists ::env(APX_ALGO_SRC)]} {
+   set apx_src $::env(APX_ALGO_SRC)
+} else {
+   set apx_src [file normalize "../../../../APx_Gen0_Algo/VivadoHls/null_algo_unpacked/vivado_hls/src"]
+}
+##
 #### Add source code
-add_files src/algo_unpacked.cpp
+add_files src/algo_unpacked.cpp -cflags "-I$apx_src"
+add_files src/LinkFormat.cc -cflags "-I$apx_src"
 add_files src/ClusterFinder.cc
-add_files src/bitonicSorter.cc
 #
 ### Add testbed files
-add_files -tb src/algo_unpacked_tb.cpp 
+add_files -tb src/algo_unpacked_tb.cpp -cflags "-I$apx_src"
 
 ### Add test input files
 #add_files -tb data/test1_inp.txt
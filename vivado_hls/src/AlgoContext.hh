@@ -0,0 +1,18 @@
+#ifndef AlgoContext_hh
+#define AlgoContext_hh
+
+#include "algo_unpacked.h"
+
+// Per-caller state of algo_unpacked (it used to live in function statics).
+// Each thread of the emulator owns its own context; the HLS top level uses a
+// fresh one per call.
+struct AlgoContext {
+   bool dump;  // print the unpacked crystals and packed clusters of the next event
+
+   AlgoContext() : dump(false) {}
+};
+
+// False if getClustersInCard failed, link_out then carrying no clusters
+bool algo_unpacked_ctx(AlgoContext &ctx, ap_uint<192> link_in[N_CH_IN], ap_uint<192> link_out[N_CH_OUT]);
+
+#endif
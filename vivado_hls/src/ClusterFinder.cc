@@ -2,7 +2,7 @@
 #include <stdio.h>
 
 #include "ClusterFinder.hh"
-#include "bitonicSorter.hh"
+#include "SortingNetwork.hh"
 
 #include <iostream>
 using namespace std;
@@ -26,14 +26,13 @@ uint16_t getPeakBinOf5(uint16_t et[NCrystalsPerEtaPhi], uint16_t etSum) {
    return iAve;
 }
 
-bool getClustersInTower(uint16_t crystals[NCrystalsPerEtaPhi][NCrystalsPerEtaPhi],
+bool getClustersInTower(const TowerView &crystals,
       uint16_t *peakEta,
       uint16_t *peakPhi,
       uint16_t *towerET,
       uint16_t *clusterET) {
 
 #pragma HLS PIPELINE II=1
-#pragma HLS ARRAY_PARTITION variable=crystals complete dim=0
 
    uint16_t phiStripSum[NCrystalsPerEtaPhi];
 #pragma HLS ARRAY_PARTITION variable=phiStripSum complete dim=0
@@ -42,7 +41,7 @@ bool getClustersInTower(uint16_t crystals[NCrystalsPerEtaPhi][NCrystalsPerEtaPhi
       phiStripSum[phi] = 0;
       for(int eta = 0; eta < NCrystalsPerEtaPhi; eta++) {
 #pragma HLS UNROLL
-	 phiStripSum[phi] += crystals[eta][phi];
+	 phiStripSum[phi] += crystals(eta, phi);
       }
    }   
    uint16_t etaStripSum[NCrystalsPerEtaPhi];
@@ -52,7 +51,7 @@ bool getClustersInTower(uint16_t crystals[NCrystalsPerEtaPhi][NCrystalsPerEtaPhi
       etaStripSum[eta] = 0;
       for(int phi = 0; phi < NCrystalsPerEtaPhi; phi++) {
 #pragma HLS UNROLL
-	 etaStripSum[eta] += crystals[eta][phi];
+	 etaStripSum[eta] += crystals(eta, phi);
       }
    }   
    // Large cluster ET is the ET of the full tower
@@ -78,6 +77,16 @@ bool getClustersInTower(uint16_t crystals[NCrystalsPerEtaPhi][NCrystalsPerEtaPhi
    return true;
 }
 
+bool getClustersInTower(uint16_t crystals[NCrystalsPerEtaPhi][NCrystalsPerEtaPhi],
+      uint16_t *peakEta,
+      uint16_t *peakPhi,
+      uint16_t *towerET,
+      uint16_t *clusterET) {
+#pragma HLS INLINE
+#pragma HLS ARRAY_PARTITION variable=crystals complete dim=0
+   return getClustersInTower(TowerView(&crystals[0][0]), peakEta, peakPhi, towerET, clusterET);
+}
+
 bool mergeClusters(
       uint16_t ieta1, uint16_t iphi1, uint16_t itet1, uint16_t icet1,
       uint16_t ieta2, uint16_t iphi2, uint16_t itet2, uint16_t icet2,
@@ -122,58 +131,15 @@ bool mergeClusters(
 }     
 
 
-bool getClustersIn3x4Region(uint16_t crystalsIn3x4Region[3][4][5][5],
-      uint16_t sortedClusterIn3x4_peakEta[NClustersPer3x4Region],
-      uint16_t sortedClusterIn3x4_peakPhi[NClustersPer3x4Region],
-      uint16_t sortedClusterIn3x4_towerEta[NClustersPer3x4Region],
-      uint16_t sortedClusterIn3x4_towerPhi[NClustersPer3x4Region],
-      uint16_t sortedClusterIn3x4_towerET[NClustersPer3x4Region],
-      uint16_t sortedClusterIn3x4_ET[NClustersPer3x4Region]
+bool mergeClustersInRegion(
+      const uint16_t peakEta_[3][4],
+      const uint16_t peakPhi_[3][4],
+      const uint16_t towerET_[3][4],
+      const uint16_t clusterET_[3][4],
+      Cluster clusters[NTowersPer3x4Region]
       ){
-#pragma HLS PIPELINE II=1
-#pragma HLS ARRAY_PARTITION variable=crystalsIn3x4Region complete dim=0
-#pragma HLS ARRAY_PARTITION variable=sortedClusterIn3x4_peakEta complete dim=0
-#pragma HLS ARRAY_PARTITION variable=sortedClusterIn3x4_peakPhi complete dim=0
-#pragma HLS ARRAY_PARTITION variable=sortedClusterIn3x4_towerEta complete dim=0
-#pragma HLS ARRAY_PARTITION variable=sortedClusterIn3x4_towerPhi complete dim=0
-#pragma HLS ARRAY_PARTITION variable=sortedClusterIn3x4_towerET complete dim=0
-#pragma HLS ARRAY_PARTITION variable=sortedClusterIn3x4_ET complete dim=0
-
-   //Here array size is 16 instead 12(3x4) for bitonic sorting (order 2^n)
-   uint16_t toSortClusterIn3x4_peakEta[16];
-   uint16_t toSortClusterIn3x4_peakPhi[16];
-   uint16_t toSortClusterIn3x4_towerEta[16];
-   uint16_t toSortClusterIn3x4_towerPhi[16];
-   uint16_t toSortClusterIn3x4_towerET[16];
-   uint16_t toSortClusterIn3x4_ET[16];
-#pragma HLS ARRAY_PARTITION variable=toSortClusterIn3x4_peakEta complete dim=0
-#pragma HLS ARRAY_PARTITION variable=toSortClusterIn3x4_peakPhi complete dim=0
-#pragma HLS ARRAY_PARTITION variable=toSortClusterIn3x4_towerEta complete dim=0
-#pragma HLS ARRAY_PARTITION variable=toSortClusterIn3x4_towerPhi complete dim=0
-#pragma HLS ARRAY_PARTITION variable=toSortClusterIn3x4_towerET complete dim=0
-#pragma HLS ARRAY_PARTITION variable=toSortClusterIn3x4_ET complete dim=0
-
-   for(int iToSort=0; iToSort<16; iToSort++){
-#pragma HLS UNROLL
-      toSortClusterIn3x4_peakEta[iToSort] = 0;
-      toSortClusterIn3x4_peakPhi[iToSort] = 0;
-      toSortClusterIn3x4_towerEta[iToSort] = 0;
-      toSortClusterIn3x4_towerPhi[iToSort] = 0;
-      toSortClusterIn3x4_towerET[iToSort] = 0;
-      toSortClusterIn3x4_ET[iToSort] = 0;
-   }
-
-   uint16_t crystalsInTower[NCrystalsPerEtaPhi][NCrystalsPerEtaPhi];
-#pragma HLS ARRAY_PARTITION variable=crystalsInTower complete dim=0
-
-   uint16_t peakEta_[3][4];
-   uint16_t peakPhi_[3][4];
-   uint16_t towerET_[3][4];
-   uint16_t clusterET_[3][4];
-#pragma HLS ARRAY_PARTITION variable=peakEta_   complete dim=0
-#pragma HLS ARRAY_PARTITION variable=peakPhi_   complete dim=0
-#pragma HLS ARRAY_PARTITION variable=towerET_   complete dim=0
-#pragma HLS ARRAY_PARTITION variable=clusterET_ complete dim=0
+#pragma HLS INLINE
+#pragma HLS ARRAY_PARTITION variable=clusters complete dim=0
 
    uint16_t mergedPeakEta_[3][4];
    uint16_t mergedPeakPhi_[3][4];
@@ -188,31 +154,10 @@ bool getClustersIn3x4Region(uint16_t crystalsIn3x4Region[3][4][5][5],
 #pragma HLS UNROLL
       for(int tPhi = 0; tPhi < 4; tPhi++) {
 #pragma HLS UNROLL
-	 peakEta_[tEta][tPhi] = 9999;
-	 peakPhi_[tEta][tPhi] = 9999;
-	 towerET_[tEta][tPhi] = 0;
-	 clusterET_[tEta][tPhi] = 0;
-
-	 for(int cEta=0; cEta<NCrystalsPerEtaPhi; cEta++){
-#pragma HLS UNROLL
-	    for(int cPhi=0; cPhi<NCrystalsPerEtaPhi; cPhi++){
-#pragma HLS UNROLL
-	       crystalsInTower[cEta][cPhi] = crystalsIn3x4Region[tEta][tPhi][cEta][cPhi];
-	    }
-	 }
-
-	 getClustersInTower(
-	       crystalsInTower, 
-	       &peakEta_[tEta][tPhi],
-	       &peakPhi_[tEta][tPhi],
-	       &towerET_[tEta][tPhi],
-	       &clusterET_[tEta][tPhi]);
-
 	 mergedPeakEta_[tEta][tPhi]  = peakEta_[tEta][tPhi];
 	 mergedPeakPhi_[tEta][tPhi]  = peakPhi_[tEta][tPhi];
 	 mergedTowerET_[tEta][tPhi]  = towerET_[tEta][tPhi];
 	 mergedClusterET_[tEta][tPhi]= clusterET_[tEta][tPhi];
-
       }
    }
 
@@ -271,286 +216,290 @@ bool getClustersIn3x4Region(uint16_t crystalsIn3x4Region[3][4][5][5],
 #pragma HLS UNROLL
       for(int tPhi = 0; tPhi < 4; tPhi++) {
 #pragma HLS UNROLL
-	 toSortClusterIn3x4_peakEta[iCluster]  = mergedPeakEta_[tEta][tPhi];
-	 toSortClusterIn3x4_peakPhi[iCluster]  = mergedPeakPhi_[tEta][tPhi];
-	 toSortClusterIn3x4_towerEta[iCluster] = tEta;
-	 toSortClusterIn3x4_towerPhi[iCluster] = tPhi;
-	 toSortClusterIn3x4_towerET[iCluster]  = mergedTowerET_[tEta][tPhi];
-	 toSortClusterIn3x4_ET[iCluster]       = mergedClusterET_[tEta][tPhi];
+	 clusters[iCluster] = Cluster(mergedClusterET_[tEta][tPhi], mergedTowerET_[tEta][tPhi],
+	       tEta, tPhi, mergedPeakEta_[tEta][tPhi], mergedPeakPhi_[tEta][tPhi]);
 	 iCluster++;
       }
    }
-   uint16_t xx;
-
-   for(int i=0;i<16;i=i+4){   
-#pragma HLS unroll
-      if(toSortClusterIn3x4_ET[i]<toSortClusterIn3x4_ET[i+1]){
-	 xx=toSortClusterIn3x4_ET[i+1];
-	 toSortClusterIn3x4_ET[i+1]=toSortClusterIn3x4_ET[i];
-	 toSortClusterIn3x4_ET[i]=xx;
-	 xx=toSortClusterIn3x4_peakEta[i];
-	 toSortClusterIn3x4_peakEta[i]=toSortClusterIn3x4_peakEta[i+1];
-	 toSortClusterIn3x4_peakEta[i+1]=xx;
-	 xx=toSortClusterIn3x4_peakPhi[i];
-	 toSortClusterIn3x4_peakPhi[i]=toSortClusterIn3x4_peakPhi[i+1];
-	 toSortClusterIn3x4_peakPhi[i+1]=xx;
-      }
 
-      if(toSortClusterIn3x4_ET[i+2]>toSortClusterIn3x4_ET[i+3]){
-	 xx=toSortClusterIn3x4_ET[i+3];
-	 toSortClusterIn3x4_ET[i+3]=toSortClusterIn3x4_ET[i+2];
-	 toSortClusterIn3x4_ET[i+2]=xx;
-	 xx=toSortClusterIn3x4_peakEta[i+2];
-	 toSortClusterIn3x4_peakEta[i+2]=toSortClusterIn3x4_peakEta[i+3];
-	 toSortClusterIn3x4_peakEta[i+3]=xx;
-	 xx=toSortClusterIn3x4_peakPhi[i+2];
-	 toSortClusterIn3x4_peakPhi[i+2]=toSortClusterIn3x4_peakPhi[i+3];
-	 toSortClusterIn3x4_peakPhi[i+3]=xx;
+   return true; 
+}
+
+bool getMergedClustersInRegion(const RegionView &region,
+      Cluster clusters[NTowersPer3x4Region]
+      ){
+#pragma HLS INLINE
+#pragma HLS ARRAY_PARTITION variable=clusters complete dim=0
+
+   uint16_t peakEta_[3][4];
+   uint16_t peakPhi_[3][4];
+   uint16_t towerET_[3][4];
+   uint16_t clusterET_[3][4];
+#pragma HLS ARRAY_PARTITION variable=peakEta_   complete dim=0
+#pragma HLS ARRAY_PARTITION variable=peakPhi_   complete dim=0
+#pragma HLS ARRAY_PARTITION variable=towerET_   complete dim=0
+#pragma HLS ARRAY_PARTITION variable=clusterET_ complete dim=0
+
+   for(int tEta = 0; tEta < 3; tEta++) {
+#pragma HLS UNROLL
+      for(int tPhi = 0; tPhi < 4; tPhi++) {
+#pragma HLS UNROLL
+	 peakEta_[tEta][tPhi] = 0;
+	 peakPhi_[tEta][tPhi] = 0;
+	 towerET_[tEta][tPhi] = 0;
+	 clusterET_[tEta][tPhi] = 0;
+
+	 // Towers past the edge of the card are left as what getClustersInTower gives
+	 // for an empty tower; they still take part in the merging and sorting below
+	 if(region.hasTower(tEta)) {
+	    getClustersInTower(
+		  region.tower(tEta, tPhi),
+		  &peakEta_[tEta][tPhi],
+		  &peakPhi_[tEta][tPhi],
+		  &towerET_[tEta][tPhi],
+		  &clusterET_[tEta][tPhi]);
+	 }
       }
    }
 
-   // passing control to second level of quaternary comparators                                                                                                                     
-   bitonic_1_4(toSortClusterIn3x4_ET,toSortClusterIn3x4_peakEta,toSortClusterIn3x4_peakPhi);
+   return mergeClustersInRegion(peakEta_, peakPhi_, towerET_, clusterET_, clusters);
+}
+
+template<uint16_t NRegionEta>
+bool getMergedClustersInRegion(uint16_t crystalsIn3x4Region[3][4][5][5],
+      Cluster clusters[NTowersPer3x4Region]
+      ){
+#pragma HLS INLINE
+#pragma HLS ARRAY_PARTITION variable=crystalsIn3x4Region complete dim=0
+   return getMergedClustersInRegion(RegionView(&crystalsIn3x4Region[0][0][0][0], NRegionEta), clusters);
+}
+
+void selectClustersInRegion(Cluster clusters[NTowersPer3x4Region]) {
+#pragma HLS INLINE
+   BitonicSelector<NTowersPer3x4Region, NClustersPer3x4Region>::select(clusters);
+}
+
+template<uint16_t NRegionEta>
+bool getClustersInRegion(uint16_t crystalsIn3x4Region[3][4][5][5],
+      Cluster sortedClusters[NClustersPer3x4Region]
+      ){
+#pragma HLS PIPELINE II=1
+#pragma HLS ARRAY_PARTITION variable=crystalsIn3x4Region complete dim=0
+#pragma HLS ARRAY_PARTITION variable=sortedClusters complete dim=0
+
+   Cluster clusters[NTowersPer3x4Region];
+#pragma HLS ARRAY_PARTITION variable=clusters complete dim=0
+
+   if(!getMergedClustersInRegion<NRegionEta>(crystalsIn3x4Region, clusters))
+      return false;
+   // Only the NClustersPer3x4Region largest are kept
+   selectClustersInRegion(clusters);
 
    for(int iSort=0; iSort<NClustersPer3x4Region; iSort++){
-      sortedClusterIn3x4_ET[iSort]      =toSortClusterIn3x4_ET[iSort]; 
-      sortedClusterIn3x4_peakEta[iSort] =toSortClusterIn3x4_peakEta[iSort];
-      sortedClusterIn3x4_peakPhi[iSort] =toSortClusterIn3x4_peakPhi[iSort];
-      sortedClusterIn3x4_towerEta[iSort]=toSortClusterIn3x4_towerEta[iSort]; // TO BE SORTED - NOT YET IN SORTER!!
-      sortedClusterIn3x4_towerPhi[iSort]=toSortClusterIn3x4_towerPhi[iSort]; // TO BE SORTED
+#pragma HLS UNROLL
+      sortedClusters[iSort] = clusters[iSort];
    }
 
-
    return true; 
 }
 
-bool getClustersInCard(
-      uint16_t crystals[NCaloLayer1Eta*NCaloLayer1Phi*NCrystalsPerEtaPhi*NCrystalsPerEtaPhi],
-      uint16_t SortedCluster_peakEta[NClustersPerCard],
-      uint16_t SortedCluster_peakPhi[NClustersPerCard],
-      uint16_t SortedCluster_towerEta[NClustersPerCard],
-      uint16_t SortedCluster_towerPhi[NClustersPerCard],
-      uint16_t SortedCluster_towerET[NClustersPerCard],
-      uint16_t SortedCluster_ET[NClustersPerCard]
+bool getClustersIn3x4Region(uint16_t crystalsIn3x4Region[3][4][5][5],
+      uint16_t sortedClusterIn3x4_peakEta[NClustersPer3x4Region],
+      uint16_t sortedClusterIn3x4_peakPhi[NClustersPer3x4Region],
+      uint16_t sortedClusterIn3x4_towerEta[NClustersPer3x4Region],
+      uint16_t sortedClusterIn3x4_towerPhi[NClustersPer3x4Region],
+      uint16_t sortedClusterIn3x4_towerET[NClustersPer3x4Region],
+      uint16_t sortedClusterIn3x4_ET[NClustersPer3x4Region]
       ){
-#pragma HLS PIPELINE II=1
-#pragma HLS ARRAY_PARTITION variable=crystals complete dim=0
-#pragma HLS ARRAY_PARTITION variable=SortedCluster_peakEta complete dim=0
-#pragma HLS ARRAY_PARTITION variable=SortedCluster_peakPhi complete dim=0
-#pragma HLS ARRAY_PARTITION variable=SortedCluster_towerEta complete dim=0
-#pragma HLS ARRAY_PARTITION variable=SortedCluster_towerPhi complete dim=0
-#pragma HLS ARRAY_PARTITION variable=SortedCluster_towerET complete dim=0
-#pragma HLS ARRAY_PARTITION variable=SortedCluster_ET complete dim=0
-
-   uint16_t crystalsET[3][4][5][5];
-#pragma HLS ARRAY_PARTITION variable=crystalsET complete dim=0
-
-   uint16_t peak_Eta[NClustersPer3x4Region];
-   uint16_t peak_Phi[NClustersPer3x4Region];
-   uint16_t tower_Eta[NClustersPer3x4Region];
-   uint16_t tower_Phi[NClustersPer3x4Region];
-   uint16_t tower_ET[NClustersPer3x4Region];
-   uint16_t clusters_ET[NClustersPer3x4Region];
-#pragma HLS ARRAY_PARTITION variable=peak_Eta complete dim=0
-#pragma HLS ARRAY_PARTITION variable=peak_Phi complete dim=0
-#pragma HLS ARRAY_PARTITION variable=tower_Eta complete dim=0
-#pragma HLS ARRAY_PARTITION variable=tower_Phi complete dim=0
-#pragma HLS ARRAY_PARTITION variable=tower_ET complete dim=0
-#pragma HLS ARRAY_PARTITION variable=clusters_ET complete dim=0
-
-   // These arrays should be of size 30 for VU9P
-   // For CTP7: they are 10: 5 cluster per region
-   uint16_t preMergeClusterPeakEta[10];
-   uint16_t preMergeClusterPeakPhi[10];
-   uint16_t preMergeClusterTowerEta[10];
-   uint16_t preMergeClusterTowerPhi[10];
-   uint16_t preMergeClusterTowerET[10];
-   uint16_t preMergeClusterET[10];
-#pragma HLS ARRAY_PARTITION variable=preMergeClusterPeakEta complete dim=0
-#pragma HLS ARRAY_PARTITION variable=preMergeClusterPeakPhi complete dim=0
-#pragma HLS ARRAY_PARTITION variable=preMergeClusterTowerEta complete dim=0
-#pragma HLS ARRAY_PARTITION variable=preMergeClusterTowerPhi complete dim=0
-#pragma HLS ARRAY_PARTITION variable=preMergeClusterTowerET complete dim=0
-#pragma HLS ARRAY_PARTITION variable=preMergeClusterET complete dim=0
+#pragma HLS INLINE
+   Cluster sortedClusters[NClustersPer3x4Region];
+#pragma HLS ARRAY_PARTITION variable=sortedClusters complete dim=0
+   if(!getClustersInRegion<3>(crystalsIn3x4Region, sortedClusters))
+      return false;
+   for(int k=0; k<NClustersPer3x4Region; k++){
+#pragma HLS UNROLL
+      sortedClusterIn3x4_peakEta[k]  = sortedClusters[k].peakEta();
+      sortedClusterIn3x4_peakPhi[k]  = sortedClusters[k].peakPhi();
+      sortedClusterIn3x4_towerEta[k] = sortedClusters[k].towerEta();
+      sortedClusterIn3x4_towerPhi[k] = sortedClusters[k].towerPhi();
+      sortedClusterIn3x4_towerET[k]  = sortedClusters[k].towerET();
+      sortedClusterIn3x4_ET[k]       = sortedClusters[k].et();
+   }
+   return true;
+}
 
+template<class Card>
+bool mergeTowerClustersInCard(
+      const uint16_t peakEta[Card::NTowersInEta][NCaloLayer1Phi],
+      const uint16_t peakPhi[Card::NTowersInEta][NCaloLayer1Phi],
+      const uint16_t towerET[Card::NTowersInEta][NCaloLayer1Phi],
+      const uint16_t clusterET[Card::NTowersInEta][NCaloLayer1Phi],
+      Cluster regionClusters[Card::NRegions][NTowersPer3x4Region]
+      ){
+#pragma HLS INLINE
    // this for-loop covers all 3x4 regions in one RCT card
-   //In CTP7: Only 5x4 fit in the card= 1-3x4 + 1-2x4
-   //In VU9P: 17x4: 5-3x4 + 1-2x4 (iRegion loop will change to <15)
-   uint16_t region = 0;
-   for(int iRegion=0; iRegion<2; iRegion+=3) {  // We are processing 5 of 17 possible etas due to CTP7 size
+   //In CTP7: 5x4 = 1-3x4 + 1-2x4
+   //In VU9P: 17x4 = 5-3x4 + 1-2x4
+   for(int iRegion=0; iRegion<Card::NRegions; iRegion++) {
 #pragma HLS UNROLL
-      for(int iClusters=0; iClusters<NClustersPer3x4Region; iClusters++){
-	 peak_Eta[iClusters]   =999;
-	 peak_Phi[iClusters]   =999;
-	 tower_Eta[iClusters]  =999;
-	 tower_Phi[iClusters]  =999;
-	 tower_ET[iClusters]   =0;
-	 clusters_ET[iClusters]=0;
-      }
+      uint16_t peakEta_[3][4];
+      uint16_t peakPhi_[3][4];
+      uint16_t towerET_[3][4];
+      uint16_t clusterET_[3][4];
+#pragma HLS ARRAY_PARTITION variable=peakEta_   complete dim=0
+#pragma HLS ARRAY_PARTITION variable=peakPhi_   complete dim=0
+#pragma HLS ARRAY_PARTITION variable=towerET_   complete dim=0
+#pragma HLS ARRAY_PARTITION variable=clusterET_ complete dim=0
+      Cluster clusters[NTowersPer3x4Region];
+#pragma HLS ARRAY_PARTITION variable=clusters complete dim=0
 
       for(int tEta = 0; tEta < 3; tEta++) {
 #pragma HLS UNROLL
-	 for(int tPhi = 0; tPhi < NCaloLayer1Phi; tPhi++) {
-#pragma HLS UNROLL
-	    for( int ceta =0; ceta<NCrystalsPerEtaPhi; ceta++) {
-#pragma HLS UNROLL
-	       for(int cphi =0; cphi<NCrystalsPerEtaPhi; cphi++) {
+	 for(int tPhi = 0; tPhi < 4; tPhi++) {
 #pragma HLS UNROLL
-
-		  int crystalID = (iRegion+tEta)*NCaloLayer1Phi*25+tPhi*25+ceta*5+cphi;
-		  if(crystalID > 5*NCaloLayer1Phi*25) {
-		     fprintf(stderr, "crystalID too large");
-		     exit(1);
-		  }
-		  crystalsET[tEta][tPhi][ceta][cphi] = crystals[crystalID];
-	       }
-	    }
+	    //The eta rows past the end of the card (2x4 or 1x4 last region) are empty towers
+	    int cardEta = iRegion*3 + tEta;
+	    bool inCard = cardEta < Card::NTowersInEta;
+	    peakEta_[tEta][tPhi]   = inCard ? peakEta[cardEta][tPhi] : 0;
+	    peakPhi_[tEta][tPhi]   = inCard ? peakPhi[cardEta][tPhi] : 0;
+	    towerET_[tEta][tPhi]   = inCard ? towerET[cardEta][tPhi] : 0;
+	    clusterET_[tEta][tPhi] = inCard ? clusterET[cardEta][tPhi] : 0;
 	 }
       }
-      getClustersIn3x4Region(crystalsET, peak_Eta, peak_Phi, tower_Eta, tower_Phi, tower_ET, clusters_ET);
+      if(!mergeClustersInRegion(peakEta_, peakPhi_, towerET_, clusterET_, clusters))
+	 return false;
 
-      for(int k=0; k<5; k++){ 
+      // Tower eta within the card
+      for(int k=0; k<NTowersPer3x4Region; k++){
 #pragma HLS UNROLL
-	 preMergeClusterPeakEta[region+k]  =peak_Eta[k];
-	 preMergeClusterPeakPhi[region+k]  =peak_Phi[k];
-	 preMergeClusterTowerEta[region+k] =0;  // tower_Eta[k];
-	 preMergeClusterTowerPhi[region+k] =0; //tower_Phi[k];
-	 preMergeClusterTowerET[region+k]  =tower_ET[k];
-	 preMergeClusterET[region+k]       =clusters_ET[k];
-
+	 const Cluster &c = clusters[k];
+	 regionClusters[iRegion][k] = Cluster(c.et(), c.towerET(), iRegion*3 + c.towerEta(), c.towerPhi(),
+	       c.peakEta(), c.peakPhi());
       }
-      region = region + NClustersPer3x4Region; 
-   }
-   //Clusters in 2x4 region ---:
-   //i2x4region variable is needed to get the correct tEta value for 2x4 region.
-   uint16_t i2x4region;
-   i2x4region = region/NClustersPer3x4Region*3;
-
-   // Reset and initialize variables for 2x4 region
-   for(int iClusters=0; iClusters<NClustersPer3x4Region; iClusters++){
-#pragma HLS UNROLL
-      peak_Eta[iClusters]   =999;
-      peak_Phi[iClusters]   =999;
-      tower_Eta[iClusters]  =999;
-      tower_Phi[iClusters]  =999;
-      tower_ET[iClusters]   =0;
-      clusters_ET[iClusters]=0;
    }
+   return true;
+}
 
-   for(int tEta = 0; tEta < 3; tEta++) { // For 2x4 region
-#pragma HLS UNROLL
-      for(int tPhi = 0; tPhi < NCaloLayer1Phi; tPhi++) {
+template<class Card>
+bool getMergedClustersInCard(
+      const uint16_t crystals[Card::NCrystals],
+      Cluster regionClusters[Card::NRegions][NTowersPer3x4Region]
+      ){
+#pragma HLS INLINE
+   uint16_t peakEta[Card::NTowersInEta][NCaloLayer1Phi];
+   uint16_t peakPhi[Card::NTowersInEta][NCaloLayer1Phi];
+   uint16_t towerET[Card::NTowersInEta][NCaloLayer1Phi];
+   uint16_t clusterET[Card::NTowersInEta][NCaloLayer1Phi];
+#pragma HLS ARRAY_PARTITION variable=peakEta   complete dim=0
+#pragma HLS ARRAY_PARTITION variable=peakPhi   complete dim=0
+#pragma HLS ARRAY_PARTITION variable=towerET   complete dim=0
+#pragma HLS ARRAY_PARTITION variable=clusterET complete dim=0
+
+   for(int iRegion = 0; iRegion < Card::NRegions; iRegion++) {
 #pragma HLS UNROLL
-	 for( int ceta =0; ceta<NCrystalsPerEtaPhi; ceta++) {
+      RegionView region = cardRegion<Card>(crystals, iRegion);
+      for(int tEta = 0; tEta < 3; tEta++) {
 #pragma HLS UNROLL
-	    for(int cphi =0; cphi<NCrystalsPerEtaPhi; cphi++) {
+	 if(!region.hasTower(tEta))
+	    continue;
+	 int cardEta = iRegion*3 + tEta;
+	 for(int tPhi = 0; tPhi < NCaloLayer1Phi; tPhi++) {
 #pragma HLS UNROLL
-	       crystalsET[tEta][tPhi][ceta][cphi] = 0;
-	       if(tEta<2){ //As this section is for 2x4 region
-
-		  int crystalID = (i2x4region+tEta)*NCaloLayer1Phi*25+tPhi*25+ceta*5+cphi;
-		  if(crystalID > 5*NCaloLayer1Phi*25) {
-		     fprintf(stderr, "crystalID too large");
-		     exit(1);
-		  }
-		  crystalsET[tEta][tPhi][ceta][cphi] = crystals[crystalID];
-	       }
-	    }
+	    getClustersInTower(region.tower(tEta, tPhi),
+		  &peakEta[cardEta][tPhi], &peakPhi[cardEta][tPhi], &towerET[cardEta][tPhi], &clusterET[cardEta][tPhi]);
 	 }
       }
    }
 
-   getClustersIn3x4Region(crystalsET, peak_Eta, peak_Phi, tower_Eta, tower_Phi, tower_ET, clusters_ET);
+   return mergeTowerClustersInCard<Card>(peakEta, peakPhi, towerET, clusterET, regionClusters);
+}
 
-   for(int k=0; k<5; k++){ 
+template<class Card>
+void mergeClustersInCard(
+      const Cluster regionClusters[Card::NRegions][NTowersPer3x4Region],
+      uint16_t SortedCluster_peakEta[Card::NClusters],
+      uint16_t SortedCluster_peakPhi[Card::NClusters],
+      uint16_t SortedCluster_towerEta[Card::NClusters],
+      uint16_t SortedCluster_towerPhi[Card::NClusters],
+      uint16_t SortedCluster_towerET[Card::NClusters],
+      uint16_t SortedCluster_ET[Card::NClusters]
+      ){
+#pragma HLS INLINE
+   // 5 clusters per region: 10 for CTP7, 30 for VU9P
+   Cluster preMergeClusters[Card::NClusters];
+   Cluster sortedClusters[Card::NClusters];
+#pragma HLS ARRAY_PARTITION variable=preMergeClusters complete dim=0
+#pragma HLS ARRAY_PARTITION variable=sortedClusters complete dim=0
+
+   for(int iRegion=0; iRegion<Card::NRegions; iRegion++) {
 #pragma HLS UNROLL
-      preMergeClusterPeakEta[region+k]  =peak_Eta[k];
-      preMergeClusterPeakPhi[region+k]  =peak_Phi[k];
-      preMergeClusterTowerEta[region+k] =0;  // tower_Eta[k];
-      preMergeClusterTowerPhi[region+k] =0; //tower_Phi[k];
-      preMergeClusterTowerET[region+k]  =tower_ET[k];
-      preMergeClusterET[region+k]       =clusters_ET[k];
-
-   }
-   //------------
-
-
-
-   // For CTP7: Sending only 10 clusters per card
-   // Sorting final 10 clusters (this will be 30 for the VU9P case)
-   //Here array size is 16 instead 12(3x4) for bitonic sorting (order 2^n)
-   uint16_t toSort_peakEta[16];
-   uint16_t toSort_peakPhi[16];
-   uint16_t toSort_towerEta[16];
-   uint16_t toSort_towerPhi[16];
-   uint16_t toSort_towerET[16];
-   uint16_t toSort_ET[16];
-#pragma HLS ARRAY_PARTITION variable=toSort_peakEta complete dim=0
-#pragma HLS ARRAY_PARTITION variable=toSort_peakPhi complete dim=0
-#pragma HLS ARRAY_PARTITION variable=toSort_towerEta complete dim=0
-#pragma HLS ARRAY_PARTITION variable=toSort_towerPhi complete dim=0
-#pragma HLS ARRAY_PARTITION variable=toSort_towerET complete dim=0
-#pragma HLS ARRAY_PARTITION variable=toSort_ET complete dim=0
-
-   for(int iToSort=0; iToSort<16; iToSort++){
+      for(int k=0; k<NClustersPer3x4Region; k++){
 #pragma HLS UNROLL
-      toSort_peakEta[iToSort] = 0;
-      toSort_peakPhi[iToSort] = 0;
-      toSort_towerEta[iToSort] = 0;
-      toSort_towerPhi[iToSort] = 0;
-      toSort_towerET[iToSort] = 0;
-      toSort_ET[iToSort] = 0;
-      if(iToSort < 10){
-	 toSort_peakEta[iToSort] = preMergeClusterPeakEta[iToSort];
-	 toSort_peakPhi[iToSort] = preMergeClusterPeakPhi[iToSort];
-	 toSort_towerEta[iToSort] = preMergeClusterTowerEta[iToSort];
-	 toSort_towerPhi[iToSort] = preMergeClusterTowerPhi[iToSort];
-	 toSort_towerET[iToSort] = preMergeClusterTowerET[iToSort];
-	 toSort_ET[iToSort] = preMergeClusterET[iToSort];
+	 preMergeClusters[iRegion*NClustersPer3x4Region+k] = regionClusters[iRegion][k];
       }
    }
 
-   uint16_t xx;
-   for(int ii=0; ii<16; ii=ii+4){
-#pragma HLS unroll 
-      if(toSort_ET[ii] < toSort_ET[ii+1]){
-	 xx=toSort_ET[ii+1];
-	 toSort_ET[ii+1]=toSort_ET[ii];
-	 toSort_ET[ii]=xx;
-	 xx=toSort_peakEta[ii];
-	 toSort_peakEta[ii]=toSort_peakEta[ii+1];
-	 toSort_peakEta[ii+1]=xx;
-	 xx=toSort_peakPhi[ii];
-	 toSort_peakPhi[ii]=toSort_peakPhi[ii+1];
-	 toSort_peakPhi[ii+1]=xx;
-      }
+   // The clusters of each region are already sorted: merging them sorts the card,
+   // clusters of equal ET coming out in region order
+   SortedListMerger<Card::NRegions, NClustersPer3x4Region>::merge(preMergeClusters, sortedClusters);
 
-      if(toSort_ET[ii+2]>toSort_ET[ii+3])
-      {xx=toSort_ET[ii+3];
-	 toSort_ET[ii+3]=toSort_ET[ii+2];
-	 toSort_ET[ii+2]=xx;
-	 xx=toSort_peakEta[ii+2];
-	 toSort_peakEta[ii+2]=toSort_peakEta[ii+3];
-	 toSort_peakEta[ii+3]=xx;
-	 xx=toSort_peakPhi[ii+2];
-	 toSort_peakPhi[ii+2]=toSort_peakPhi[ii+3];
-	 toSort_peakPhi[ii+3]=xx;
-      }    
-   }        
-   // passing control to second level of quaternary comparators
-   bitonic_1_4(toSort_ET,toSort_peakEta,toSort_peakPhi);
-   //Sorting ends, assigning sorted clusters to final set of variables.
-
-
-   for(int kk=0; kk<10; kk++){ // kk<NClustersPerCard : For now sending 10 only
+   for(int kk=0; kk<Card::NClusters; kk++){
 #pragma HLS UNROLL
-      SortedCluster_peakEta[kk]  = toSort_peakEta[kk];
-      SortedCluster_peakPhi[kk]  = toSort_peakPhi[kk];
-      SortedCluster_towerEta[kk] = 0; //preMergeClusterTowerEta[kk];
-      SortedCluster_towerPhi[kk] = 0; //preMergeClusterTowerPhi[kk];
-      SortedCluster_towerET[kk]  = 0; //preMergeClusterTowerET[kk];
-      SortedCluster_ET[kk]       = toSort_ET[kk];
+      SortedCluster_peakEta[kk]  = sortedClusters[kk].peakEta();
+      SortedCluster_peakPhi[kk]  = sortedClusters[kk].peakPhi();
+      SortedCluster_towerEta[kk] = sortedClusters[kk].towerEta();
+      SortedCluster_towerPhi[kk] = sortedClusters[kk].towerPhi();
+      SortedCluster_towerET[kk]  = sortedClusters[kk].towerET();
+      SortedCluster_ET[kk]       = sortedClusters[kk].et();
    }
+}
+
+template<class Card>
+bool getClustersInCard(
+      const uint16_t crystals[Card::NCrystals],
+      uint16_t SortedCluster_peakEta[Card::NClusters],
+      uint16_t SortedCluster_peakPhi[Card::NClusters],
+      uint16_t SortedCluster_towerEta[Card::NClusters],
+      uint16_t SortedCluster_towerPhi[Card::NClusters],
+      uint16_t SortedCluster_towerET[Card::NClusters],
+      uint16_t SortedCluster_ET[Card::NClusters]
+      ){
+#pragma HLS PIPELINE II=1
+#pragma HLS ARRAY_PARTITION variable=crystals complete dim=0
+#pragma HLS ARRAY_PARTITION variable=SortedCluster_peakEta complete dim=0
+#pragma HLS ARRAY_PARTITION variable=SortedCluster_peakPhi complete dim=0
+#pragma HLS ARRAY_PARTITION variable=SortedCluster_towerEta complete dim=0
+#pragma HLS ARRAY_PARTITION variable=SortedCluster_towerPhi complete dim=0
+#pragma HLS ARRAY_PARTITION variable=SortedCluster_towerET complete dim=0
+#pragma HLS ARRAY_PARTITION variable=SortedCluster_ET complete dim=0
+
+   Cluster regionClusters[Card::NRegions][NTowersPer3x4Region];
+#pragma HLS ARRAY_PARTITION variable=regionClusters complete dim=0
+
+   if(!getMergedClustersInCard<Card>(crystals, regionClusters))
+      return false;
+   for(int iRegion=0; iRegion<Card::NRegions; iRegion++) {
+#pragma HLS UNROLL
+      selectClustersInRegion(regionClusters[iRegion]);
+   }
+   mergeClustersInCard<Card>(regionClusters, SortedCluster_peakEta, SortedCluster_peakPhi,
+	 SortedCluster_towerEta, SortedCluster_towerPhi, SortedCluster_towerET, SortedCluster_ET);
 
    return true;
 }
+
+#define INSTANTIATE_CARD(Card) \
+   template bool mergeTowerClustersInCard<Card>(const uint16_t[Card::NTowersInEta][NCaloLayer1Phi], \
+	 const uint16_t[Card::NTowersInEta][NCaloLayer1Phi], const uint16_t[Card::NTowersInEta][NCaloLayer1Phi], \
+	 const uint16_t[Card::NTowersInEta][NCaloLayer1Phi], Cluster[Card::NRegions][NTowersPer3x4Region]); \
+   template bool getMergedClustersInCard<Card>(const uint16_t[Card::NCrystals], \
+	 Cluster[Card::NRegions][NTowersPer3x4Region]); \
+   template void mergeClustersInCard<Card>(const Cluster[Card::NRegions][NTowersPer3x4Region], \
+	 uint16_t[Card::NClusters], uint16_t[Card::NClusters], uint16_t[Card::NClusters], \
+	 uint16_t[Card::NClusters], uint16_t[Card::NClusters], uint16_t[Card::NClusters]); \
+   template bool getClustersInCard<Card>(const uint16_t[Card::NCrystals], \
+	 uint16_t[Card::NClusters], uint16_t[Card::NClusters], uint16_t[Card::NClusters], \
+	 uint16_t[Card::NClusters], uint16_t[Card::NClusters], uint16_t[Card::NClusters]);
+
+INSTANTIATE_CARD(CTP7Card)
+INSTANTIATE_CARD(VU9PCard)
@@ -10,13 +10,101 @@ const uint16_t NCaloLayer1Phi = 4;
 
 const uint16_t NCrystalsPerEtaPhi = 5;
 const uint16_t NClustersPer3x4Region = 5;
+const uint16_t NTowersPer3x4Region = 12;  // one cluster per tower before the selection
 
-const uint16_t NClustersPerCard = 12;
+const uint16_t NClustersPerCard = 12; // cluster slots in the output links
 const uint16_t Total_clusters = 30;
 
+/*
+ * Layout of one RCT card: NEta x NCaloLayer1Phi towers of 5x5 crystals, tiled in
+ * eta by 3x4 regions plus one narrower region for the remaining 1 or 2 eta rows.
+ * Each region yields NClustersPer3x4Region sorted clusters; the card sorts them all.
+ */
+template<uint16_t NEta>
+struct CardGeometry {
+   static const uint16_t NTowersInEta = NEta;
+   static const uint16_t NTowersInPhi = NCaloLayer1Phi;
+   static const uint16_t NCrystals = NEta * NCaloLayer1Phi * NCrystalsPerEtaPhi * NCrystalsPerEtaPhi;
+   static const uint16_t NFullRegions = NEta / 3;
+   static const uint16_t NTailEta = NEta % 3;            // eta rows in the last region, 0 if none
+   static const uint16_t NRegions = NFullRegions + (NTailEta > 0 ? 1 : 0);
+   static const uint16_t NClusters = NRegions * NClustersPer3x4Region;
+};
+
+typedef CardGeometry<5> CTP7Card;   // 1 3x4 + 1 2x4 region, 10 clusters
+typedef CardGeometry<17> VU9PCard;  // 5 3x4 + 1 2x4 regions, Total_clusters
+typedef CardGeometry<NCaloLayer1Eta> RCTCard;  // card emulated by algo_unpacked
+
+/*
+ * One cluster packed in a single word, so that the sorters move one value:
+ * bits 47-32 cluster ET, 31-16 tower ET, 15-10 tower eta, 9-6 tower phi,
+ * 5-3 peak eta and 2-0 peak phi.
+ * Clusters compare by ET only, so the sorters order clusters of equal ET as
+ * they did when sorting the ET array.
+ */
+struct Cluster {
+   uint64_t data;
+
+   Cluster() : data(0) {}
+   Cluster(uint16_t et, uint16_t towerET, uint16_t towerEta, uint16_t towerPhi, uint16_t peakEta, uint16_t peakPhi) :
+      data(((uint64_t) et << 32) | ((uint64_t) towerET << 16) | ((uint64_t) (towerEta & 0x3F) << 10) |
+	    ((towerPhi & 0xF) << 6) | ((peakEta & 0x7) << 3) | (peakPhi & 0x7)) {}
+
+   uint16_t et() const { return data >> 32; }
+   uint16_t towerET() const { return (data >> 16) & 0xFFFF; }
+   uint16_t towerEta() const { return (data >> 10) & 0x3F; }
+   uint16_t towerPhi() const { return (data >> 6) & 0xF; }
+   uint16_t peakEta() const { return (data >> 3) & 0x7; }
+   uint16_t peakPhi() const { return data & 0x7; }
+
+   bool operator<(const Cluster &c) const { return et() < c.et(); }
+};
+
 //const bool _test = true;
 const uint16_t NCrystalsInPhi = (NCaloLayer1Cards * NCaloLayer1Phi * NCrystalsPerEtaPhi);
 const uint16_t NCrystalsInEta = (NCaloLayer1Eta * NCrystalsPerEtaPhi);
+const uint16_t NCrystalsPerCard = RCTCard::NCrystals;
+
+/*
+ * Read only views of crystals in place, in the tower-major layout of the card
+ * crystal array (crystalID = ((tEta * NCaloLayer1Phi + tPhi) * 5 + cEta) * 5 + cPhi),
+ * which is also that of a uint16_t [3][4][5][5] region array.
+ *
+ * TowerView is the 5x5 crystals of one tower (strides 5, 1). RegionView is the
+ * 3x4 towers of a region starting at a tower row (strides 100, 25, 5, 1); its eta
+ * rows nEta and above are past the edge of the card: they read as empty towers
+ * and are never dereferenced, instead of being materialized as zero padding.
+ */
+struct TowerView {
+   const uint16_t *data;
+
+   explicit TowerView(const uint16_t *towerCrystals) : data(towerCrystals) {}
+
+   uint16_t operator()(int cEta, int cPhi) const { return data[cEta * NCrystalsPerEtaPhi + cPhi]; }
+};
+
+struct RegionView {
+   static const int TowerStride = NCrystalsPerEtaPhi * NCrystalsPerEtaPhi;
+   static const int RowStride = NCaloLayer1Phi * TowerStride;
+
+   const uint16_t *data;
+   int nEta;
+
+   RegionView(const uint16_t *firstRow, int nEtaInCard) : data(firstRow), nEta(nEtaInCard) {}
+
+   bool hasTower(int tEta) const { return tEta < nEta; }
+   TowerView tower(int tEta, int tPhi) const { return TowerView(&data[tEta * RowStride + tPhi * TowerStride]); }
+   uint16_t operator()(int tEta, int tPhi, int cEta, int cPhi) const {
+      return hasTower(tEta) ? tower(tEta, tPhi)(cEta, cPhi) : 0;
+   }
+};
+
+// Region iRegion (tower rows iRegion * 3 ...) of the card crystals
+template<class Card>
+RegionView cardRegion(const uint16_t crystals[Card::NCrystals], int iRegion) {
+   int nEta = Card::NTowersInEta - iRegion * 3;
+   return RegionView(&crystals[iRegion * 3 * RegionView::RowStride], nEta < 3 ? nEta : 3);
+}
 
 uint16_t getPeakBinOf5(uint16_t et[NCrystalsPerEtaPhi], uint16_t etSum);
 
@@ -27,6 +115,14 @@ bool mergeClusters(
       uint16_t *eta2, uint16_t *phi2, uint16_t *tet2, uint16_t *cet2
       );
 
+bool getClustersInTower(
+      const TowerView &crystals,
+      uint16_t *peakEta,
+      uint16_t *peakPhi,
+      uint16_t *towerET,
+      uint16_t *clusterET
+      );
+
 bool getClustersInTower(
       uint16_t crystals[NCrystalsPerEtaPhi][NCrystalsPerEtaPhi], 
       uint16_t *peakEta,
@@ -35,6 +131,41 @@ bool getClustersInTower(
       uint16_t *clusterET
       );
 
+// Merges the split clusters of neighboring towers of a region, given the
+// getClustersInTower results of its towers: one cluster per tower, in tower order
+bool mergeClustersInRegion(
+      const uint16_t peakEta[3][4],
+      const uint16_t peakPhi[3][4],
+      const uint16_t towerET[3][4],
+      const uint16_t clusterET[3][4],
+      Cluster clusters[NTowersPer3x4Region]
+      );
+
+// Tower eta and phi of the clusters are within the region. One cluster per
+// tower after the merging of split clusters, in tower order
+bool getMergedClustersInRegion(
+      const RegionView &region,
+      Cluster clusters[NTowersPer3x4Region]
+      );
+
+// Same on a region array, whose eta rows NRegionEta and above are empty (edge
+// of the card) and are not read
+template<uint16_t NRegionEta>
+bool getMergedClustersInRegion(
+      uint16_t crystalsIn3x4Region[3][4][5][5],
+      Cluster clusters[NTowersPer3x4Region]
+      );
+
+// Puts the NClustersPer3x4Region clusters of largest ET first, by decreasing ET
+void selectClustersInRegion(Cluster clusters[NTowersPer3x4Region]);
+
+// The two above: the NClustersPer3x4Region leading clusters of the region
+template<uint16_t NRegionEta>
+bool getClustersInRegion(
+      uint16_t crystalsIn3x4Region[3][4][5][5],
+      Cluster sortedClusters[NClustersPer3x4Region]
+      );
+
 bool getClustersIn3x4Region(
       uint16_t crystalsIn3x4Region[3][4][5][5],
       uint16_t clusterIn3x4Region_peakEta[12],
@@ -45,14 +176,48 @@ bool getClustersIn3x4Region(
       uint16_t clusterIn3x4Region_ET[12]
       );
 
+// getClustersInCard in steps, for the emulator to batch the tower and selection
+// steps: getClustersInTower of every tower of the card, mergeClustersInRegion of
+// every region (tower eta within the card, eta rows past the end of the card
+// being empty towers), then, after selectClustersInRegion of each region, the
+// merging of their sorted clusters into the output arrays
+template<class Card>
+bool mergeTowerClustersInCard(
+      const uint16_t peakEta[Card::NTowersInEta][NCaloLayer1Phi],
+      const uint16_t peakPhi[Card::NTowersInEta][NCaloLayer1Phi],
+      const uint16_t towerET[Card::NTowersInEta][NCaloLayer1Phi],
+      const uint16_t clusterET[Card::NTowersInEta][NCaloLayer1Phi],
+      Cluster regionClusters[Card::NRegions][NTowersPer3x4Region]
+      );
+
+// getClustersInTower of every tower, then mergeTowerClustersInCard
+template<class Card>
+bool getMergedClustersInCard(
+      const uint16_t crystals[Card::NCrystals],
+      Cluster regionClusters[Card::NRegions][NTowersPer3x4Region]
+      );
+
+template<class Card>
+void mergeClustersInCard(
+      const Cluster regionClusters[Card::NRegions][NTowersPer3x4Region],
+      uint16_t SortedCluster_peakEta[Card::NClusters],
+      uint16_t SortedCluster_peakPhi[Card::NClusters],
+      uint16_t SortedCluster_towerEta[Card::NClusters],
+      uint16_t SortedCluster_towerPhi[Card::NClusters],
+      uint16_t SortedCluster_towerET[Card::NClusters],
+      uint16_t SortedCluster_ET[Card::NClusters]
+      );
+
+// Writes the Card::NClusters leading entries of the output arrays
+template<class Card>
 bool getClustersInCard(
-      uint16_t crystals[NCaloLayer1Eta*NCaloLayer1Phi*NCrystalsPerEtaPhi*NCrystalsPerEtaPhi],
-      uint16_t SortedCluster_peakEta[12],
-      uint16_t SortedCluster_peakPhi[12],
-      uint16_t SortedCluster_towerEta[12],
-      uint16_t SortedCluster_towerPhi[12],
-      uint16_t SortedCluster_towerET[12],
-      uint16_t SortedCluster_ET[12]
+      const uint16_t crystals[Card::NCrystals],
+      uint16_t SortedCluster_peakEta[Card::NClusters],
+      uint16_t SortedCluster_peakPhi[Card::NClusters],
+      uint16_t SortedCluster_towerEta[Card::NClusters],
+      uint16_t SortedCluster_towerPhi[Card::NClusters],
+      uint16_t SortedCluster_towerET[Card::NClusters],
+      uint16_t SortedCluster_ET[Card::NClusters]
       );
 
 
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "LinkFormat.hh"
+
+void unpackCrystals(ap_uint<192> link_in[N_CH_IN],
+      uint16_t crystals[NCrystalsPerCard],
+      bool dump) {
+#pragma HLS INLINE
+ for(int link = 0; link < NCrystalLinks; link++) {
+#pragma HLS UNROLL
+		for(int slot = 0; slot < NCrystalsPerLink; slot++) {
+#pragma HLS UNROLL
+		   int crystalID = link * NCrystalsPerLink + slot;
+		   if(crystalID >= NCrystalsPerCard)
+		      break;
+		   int bitLo = (slot + 1) * 16;
+		   int bitHi = bitLo + 15;
+		   crystals[crystalID] = link_in[link].range(bitHi, bitLo);
+#ifndef __SYNTHESIS__
+		   if(dump && crystals[crystalID] > 0) printf("crystals[%d] = link_in[%d].range(%d, %d) = %d;\n", crystalID, link, bitHi, bitLo, crystals[crystalID]);
+#endif
+		}
+	     }
+}
+
+uint32_t packClusterWord(const uint16_t field[NClusterWordFields]) {
+#pragma HLS INLINE
+   uint32_t word = 0;
+   for(int f = 0; f < NClusterWordFields; f++) {
+#pragma HLS UNROLL
+      uint32_t mask = (1u << ClusterWordLayout[f].width) - 1;
+      word |= (field[f] & mask) << ClusterWordLayout[f].lo;
+   }
+   return word;
+}
+
+void unpackClusterWord(uint32_t word, uint16_t field[NClusterWordFields]) {
+#pragma HLS INLINE
+   for(int f = 0; f < NClusterWordFields; f++) {
+#pragma HLS UNROLL
+      uint32_t mask = (1u << ClusterWordLayout[f].width) - 1;
+      field[f] = (word >> ClusterWordLayout[f].lo) & mask;
+   }
+}
+
+void packClusters(const uint16_t sortedCluster_peakEta[NClustersPerCard],
+      const uint16_t sortedCluster_peakPhi[NClustersPerCard],
+      const uint16_t sortedCluster_towerEta[NClustersPerCard],
+      const uint16_t sortedCluster_towerPhi[NClustersPerCard],
+      const uint16_t sortedCluster_ET[NClustersPerCard],
+      ap_uint<192> link_out[N_CH_OUT],
+      bool dump) {
+#pragma HLS INLINE
+ // The distinct links, built once
+ ap_uint<192> words[NDistinctOutputLinks];
+#pragma HLS ARRAY_PARTITION variable=words complete dim=0
+ for(int olink = 0; olink < NDistinctOutputLinks; olink++) {
+ #pragma HLS UNROLL
+    words[olink] = 0;
+ }
+
+ for(int item = 0; item < NClustersPerCard; item++) {
+ #pragma HLS UNROLL
+    int olink = item / NClustersPerLink;
+    int bLo = FirstClusterBit + (item % NClustersPerLink) * NClusterWordBits;
+    uint16_t field[NClusterWordFields];
+    field[PeakEtaField] = sortedCluster_peakEta[item];
+    field[PeakPhiField] = sortedCluster_peakPhi[item];
+    field[TowerEtaField] = sortedCluster_towerEta[item];
+    field[TowerPhiField] = sortedCluster_towerPhi[item];
+    field[ETField] = sortedCluster_ET[item];
+    words[olink].range(bLo + NClusterWordBits - 1, bLo) = packClusterWord(field);
+#ifndef __SYNTHESIS__
+    if(dump) {
+       static const char *name[NClusterWordFields] = { "peakEta", "peakPhi", "towerEta", "towerPhi", "ET" };
+       for(int f = 0; f < NClusterWordFields; f++) {
+	  int lo = bLo + ClusterWordLayout[f].lo;
+	  int hi = lo + ClusterWordLayout[f].width - 1;
+	  printf("link_out[%d].range(%d, %d) = ap_uint<%d>(sortedCluster_%s[%d]) = %d;\n", olink, hi, lo,
+		ClusterWordLayout[f].width, name[f], item, field[f]);
+       }
+    }
+#endif
+ }
+
+ for(int o = 0; o < N_CH_OUT; o++) {
+ #pragma HLS UNROLL
+    link_out[o] = words[o % NDistinctOutputLinks];
+ }
+}
+
+void unpackClusters(const ap_uint<192> link_out[N_CH_OUT],
+      uint16_t sortedCluster_peakEta[NClustersPerCard],
+      uint16_t sortedCluster_peakPhi[NClustersPerCard],
+      uint16_t sortedCluster_towerEta[NClustersPerCard],
+      uint16_t sortedCluster_towerPhi[NClustersPerCard],
+      uint16_t sortedCluster_ET[NClustersPerCard]) {
+#pragma HLS INLINE
+ for(int item = 0; item < NClustersPerCard; item++) {
+ #pragma HLS UNROLL
+    int bLo = FirstClusterBit + (item % NClustersPerLink) * NClusterWordBits;
+    uint16_t field[NClusterWordFields];
+    unpackClusterWord(link_out[item / NClustersPerLink].range(bLo + NClusterWordBits - 1, bLo), field);
+    sortedCluster_peakEta[item] = field[PeakEtaField];
+    sortedCluster_peakPhi[item] = field[PeakPhiField];
+    sortedCluster_towerEta[item] = field[TowerEtaField];
+    sortedCluster_towerPhi[item] = field[TowerPhiField];
+    sortedCluster_ET[item] = field[ETField];
+ }
+}
@@ -0,0 +1,70 @@
+#ifndef LinkFormat_hh
+#define LinkFormat_hh
+
+#include <stdint.h>
+
+#include "algo_unpacked.h"
+#include "ClusterFinder.hh"
+
+const uint16_t NCrystalsPerLink = 11; // Bits 16-31, 32-47, ..., 176-191, keeping range(15, 0) unused
+const uint16_t MaxCrystals = N_CH_IN * NCrystalsPerLink;
+const uint16_t NCrystalLinks = (NCrystalsPerCard + NCrystalsPerLink - 1) / NCrystalsPerLink; // links carrying crystals
+typedef char CardCrystalsFitInLinks[NCrystalsPerCard <= MaxCrystals ? 1 : -1];
+
+// Input links -> card crystals (crystalID = link * NCrystalsPerLink + slot, in
+// bits 16 * (slot + 1) + 15 ... 16 * (slot + 1) of the link)
+void unpackCrystals(ap_uint<192> link_in[N_CH_IN],
+      uint16_t crystals[NCrystalsPerCard],
+      bool dump);
+
+// Output cluster word: 32 bits per cluster, fields from bit 0 in this order
+enum ClusterWordField { PeakEtaField, PeakPhiField, TowerEtaField, TowerPhiField, ETField, NClusterWordFields };
+
+struct LinkField {
+   uint16_t lo;
+   uint16_t width;
+};
+
+// The one definition of the output format, used by packClusters and unpackClusters
+static const LinkField ClusterWordLayout[NClusterWordFields] = {
+   { 0, 3 },    // peakEta
+   { 3, 3 },    // peakPhi
+   { 6, 6 },    // towerEta
+   { 12, 4 },   // towerPhi
+   { 16, 16 }   // ET
+};
+
+const uint16_t NClusterWordBits = 32;
+const uint16_t FirstClusterBit = 32;     // cluster words in bits 32-63, 64-95, 96-127
+const uint16_t NClustersPerLink = 3;
+const uint16_t NDistinctOutputLinks = NClustersPerCard / NClustersPerLink;  // replicated over all N_CH_OUT links
+typedef char ClustersFillOutputLinks[(NClustersPerCard % NClustersPerLink == 0 && N_CH_OUT % NDistinctOutputLinks == 0
+      && FirstClusterBit + NClustersPerLink * NClusterWordBits <= 192) ? 1 : -1];
+typedef char CardClustersFitInLinks[RCTCard::NClusters <= NClustersPerCard ? 1 : -1];  // the slots packClusters fills
+
+// Cluster fields -> cluster word (each field truncated to its width)
+uint32_t packClusterWord(const uint16_t field[NClusterWordFields]);
+
+// Cluster word -> cluster fields
+void unpackClusterWord(uint32_t word, uint16_t field[NClusterWordFields]);
+
+// Sorted card clusters -> output links: clusters 0-2, 3-5, 6-8 and 9-11 go to
+// links 0, 1, 2 and 3, which are then replicated every fourth link
+void packClusters(const uint16_t sortedCluster_peakEta[NClustersPerCard],
+      const uint16_t sortedCluster_peakPhi[NClustersPerCard],
+      const uint16_t sortedCluster_towerEta[NClustersPerCard],
+      const uint16_t sortedCluster_towerPhi[NClustersPerCard],
+      const uint16_t sortedCluster_ET[NClustersPerCard],
+      ap_uint<192> link_out[N_CH_OUT],
+      bool dump);
+
+// Output links -> card clusters, the inverse of packClusters (reads the first
+// NDistinctOutputLinks links)
+void unpackClusters(const ap_uint<192> link_out[N_CH_OUT],
+      uint16_t sortedCluster_peakEta[NClustersPerCard],
+      uint16_t sortedCluster_peakPhi[NClustersPerCard],
+      uint16_t sortedCluster_towerEta[NClustersPerCard],
+      uint16_t sortedCluster_towerPhi[NClustersPerCard],
+      uint16_t sortedCluster_ET[NClustersPerCard]);
+
+#endif
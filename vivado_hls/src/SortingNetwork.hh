@@ -0,0 +1,427 @@
+#ifndef SortingNetwork_hh
+#define SortingNetwork_hh
+
+#include <stdint.h>
+
+/*
+ * Bitonic sorting and top-K selection networks for any number of entries, generated
+ * at compile time from template recursion (no C++11 needed, so they go through
+ * Vivado HLS as is).
+ *
+ * BitonicSorter<N>::sort(key, payload) sorts key[0..N-1] by decreasing value
+ * (increasing for Descending = false) and moves payload[] along with the keys.
+ * It is the network of the legacy bitonicSorter.cc: for block sizes K = 2, 4, ...,
+ * NPadded the half cleaners of distance K/2 ... 1, blocks of K sorted in the
+ * final direction when (i & K) == 0 and in the opposite one otherwise. Equal
+ * keys are never swapped, so ties come out in the same order as there. The
+ * comparators that only reach the padding outputs (found walking back from the
+ * outputs) and those between two padding entries (found walking forward from the
+ * inputs) are left out, NComparators and NStages give its size and depth.
+ *
+ * When N is not a power of two, the entries N..NPadded-1 are padding: Payload()
+ * with the lowest key Key() (the largest, ~Key(), for an increasing sort). They
+ * take part in the compare-exchanges like the zero padded arrays of the legacy
+ * sorts did, so equal keys still come out in the same order, and a padding entry
+ * can end up in the first N outputs in place of a real entry of the same key.
+ *
+ * BitonicSelector<N, K>::select(key, payload) puts the K largest keys (smallest
+ * for Descending = false) sorted in key[0..K-1], key[K..N-1] and payload[K..N-1]
+ * are left unspecified. It is a merge and discard network, without padding: the
+ * two halves of the input select their own K entries, then entry i of the first
+ * list is compared with entry L - 1 - i of the second (L = the number of entries
+ * kept) and the larger stays. Those L entries, the first ones of the first list
+ * followed by the last ones of the second, are bitonic and a bitonic merge of L
+ * entries sorts them: compare-exchanges at distance M, the largest power of two
+ * below L, then the merges of the first L - M and of the last M entries. Inputs
+ * of K entries or less are sorted the same way, without discarding. On equal keys
+ * the first list is kept, but the order of equal keys is not that of a stable
+ * sort. NComparators and NStages give its size and depth: 12 entries to 5 take
+ * 34 comparators in 11 stages, 16 to 1 is a 15 comparator tree of 4 stages.
+ *
+ * SortedListMerger<NLists, L>::merge merges NLists lists of L entries, each already
+ * sorted, into one sorted list of NLists * L. It is stable: equal keys come out
+ * in list order, then in their order within the list. Every entry finds its
+ * output position from its position in its own list plus the number of entries
+ * of the other lists that go before it: one stage of L * L * NLists * (NLists - 1) / 2
+ * comparators (one per pair of entries of different lists, its result counts for
+ * one entry and its complement for the other) instead of a compare-exchange chain.
+ * mergeSequential gives the same output with a sequential merge of the list
+ * heads, which is cheaper in software.
+ *
+ * All of them have key only overloads, for keys that carry all the data (the
+ * key type then only needs operator<).
+ */
+
+template<int N>
+struct NextPow2 {
+   static const int value = 2 * NextPow2<(N + 1) / 2>::value;
+};
+
+template<>
+struct NextPow2<1> {
+   static const int value = 1;
+};
+
+// Key of the padding entries, sorted after every other key
+template<class Key, bool Descending>
+struct SortPadding {
+   static Key key() { return Key(); }
+};
+
+template<class Key>
+struct SortPadding<Key, false> {
+   static Key key() { return Key(~Key()); }
+};
+
+// Payload of the sorts whose key carries all the data (the key only overloads)
+struct NoPayload {};
+
+template<class Payload>
+inline void swapPayload(Payload payload[], int i, int l) {
+#pragma HLS INLINE
+   Payload p = payload[i];
+   payload[i] = payload[l];
+   payload[l] = p;
+}
+
+inline void swapPayload(NoPayload *, int, int) {}
+
+template<class Payload>
+inline void movePayload(Payload to[], int t, const Payload from[], int f) {
+#pragma HLS INLINE
+   to[t] = from[f];
+}
+
+inline void movePayload(NoPayload *, int, const NoPayload *, int) {}
+
+template<bool Descending, class Key, class Payload>
+inline void compareExchange(Key key[], Payload payload[], int i, int l) {
+#pragma HLS INLINE
+   if(Descending ? (key[i] < key[l]) : (key[l] < key[i])) {
+      Key k = key[i];
+      key[i] = key[l];
+      key[l] = k;
+      swapPayload(payload, i, l);
+   }
+}
+
+// Network positions as bit masks (up to 64 entries)
+
+// Positions i with (i & J) == 0, i.e. the first inputs of the comparators at distance J
+template<int J> struct LowerOfPairs;
+template<> struct LowerOfPairs<1>  { static const uint64_t mask = 0x5555555555555555ull; };
+template<> struct LowerOfPairs<2>  { static const uint64_t mask = 0x3333333333333333ull; };
+template<> struct LowerOfPairs<4>  { static const uint64_t mask = 0x0F0F0F0F0F0F0F0Full; };
+template<> struct LowerOfPairs<8>  { static const uint64_t mask = 0x00FF00FF00FF00FFull; };
+template<> struct LowerOfPairs<16> { static const uint64_t mask = 0x0000FFFF0000FFFFull; };
+template<> struct LowerOfPairs<32> { static const uint64_t mask = 0x00000000FFFFFFFFull; };
+
+// Positions paired with those of Mask by the comparators at distance J
+template<uint64_t Mask, int J>
+struct Partners {
+   static const uint64_t mask = ((Mask & LowerOfPairs<J>::mask) << J) | ((Mask >> J) & LowerOfPairs<J>::mask);
+};
+
+template<uint64_t Mask>
+struct PopCount {
+   static const int value = (int) (Mask & 1) + PopCount<(Mask >> 1)>::value;
+};
+
+template<>
+struct PopCount<0> {
+   static const int value = 0;
+};
+
+template<int N>
+struct FirstPositions {
+   static const uint64_t mask = N >= 64 ? ~0ull : ((1ull << (N % 64)) - 1);
+};
+
+// Half cleaner following the one at distance J in the merge of blocks of K
+template<int K, int J>
+struct NextHalfCleaner {
+   static const int k = J > 1 ? K : 2 * K;
+   static const int j = J > 1 ? J / 2 : K;
+};
+
+// Positions whose value before the half cleaner (K, J) reaches the first KOut outputs
+template<int NPadded, int KOut, int K, int J, bool End = (K > NPadded)>
+struct BitonicLive {
+   static const uint64_t after = BitonicLive<NPadded, KOut,
+      NextHalfCleaner<K, J>::k, NextHalfCleaner<K, J>::j>::mask;
+   static const uint64_t mask = after | Partners<after, J>::mask;
+};
+
+template<int NPadded, int KOut, int K, int J>
+struct BitonicLive<NPadded, KOut, K, J, true> {
+   static const uint64_t mask = FirstPositions<KOut>::mask;
+};
+
+/*
+ * Half cleaner (K, J) and the ones after it. Pads are the positions that still
+ * hold padding before it; the comparators kept are those not between two padding
+ * entries and with an output still needed.
+ */
+template<int NPadded, int KOut, int K, int J, uint64_t Pads, bool Descending, bool End = (K > NPadded)>
+struct BitonicStage {
+   static const uint64_t live = BitonicLive<NPadded, KOut,
+      NextHalfCleaner<K, J>::k, NextHalfCleaner<K, J>::j>::mask;
+   static const uint64_t padPairs = Pads & Partners<Pads, J>::mask;
+   static const uint64_t comparators = LowerOfPairs<J>::mask & FirstPositions<NPadded>::mask
+      & ~padPairs & (live | Partners<live, J>::mask);
+
+   typedef BitonicStage<NPadded, KOut, NextHalfCleaner<K, J>::k, NextHalfCleaner<K, J>::j,
+	   padPairs, Descending> Next;
+   static const int NComparators = PopCount<comparators>::value + Next::NComparators;
+   static const int NStages = (comparators != 0) + Next::NStages;
+
+   template<class Key, class Payload>
+   static void apply(Key key[NPadded], Payload payload[NPadded]) {
+#pragma HLS INLINE
+      for(int i = 0; i < NPadded; i++) {
+#pragma HLS UNROLL
+	 if((comparators >> i) & 1) {
+	    if((i & K) == 0)
+	       compareExchange<Descending>(key, payload, i, i + J);
+	    else
+	       compareExchange<!Descending>(key, payload, i, i + J);
+	 }
+      }
+      Next::apply(key, payload);
+   }
+};
+
+template<int NPadded, int KOut, int K, int J, uint64_t Pads, bool Descending>
+struct BitonicStage<NPadded, KOut, K, J, Pads, Descending, true> {
+   static const int NComparators = 0;
+   static const int NStages = 0;
+
+   template<class Key, class Payload>
+   static void apply(Key *, Payload *) {}
+};
+
+template<int N, bool Descending = true>
+struct BitonicSorter {
+   static const int NPadded = NextPow2<N>::value;
+   typedef char NPaddedAtMost64[NPadded <= 64 ? 1 : -1];
+
+   typedef BitonicStage<NPadded, N, 2, 1, FirstPositions<NPadded>::mask & ~FirstPositions<N>::mask,
+	   Descending> Network;
+   static const int NComparators = Network::NComparators;
+   static const int NStages = Network::NStages;
+
+   template<class Key, class Payload>
+   static void sort(Key key[N], Payload payload[N]) {
+#pragma HLS INLINE
+      Key paddedKey[NPadded];
+      Payload paddedPayload[NPadded];
+#pragma HLS ARRAY_PARTITION variable=paddedKey complete dim=0
+#pragma HLS ARRAY_PARTITION variable=paddedPayload complete dim=0
+      for(int i = 0; i < NPadded; i++) {
+#pragma HLS UNROLL
+	 paddedKey[i] = i < N ? key[i] : SortPadding<Key, Descending>::key();
+	 paddedPayload[i] = i < N ? payload[i] : Payload();
+      }
+
+      Network::apply(paddedKey, paddedPayload);
+
+      for(int i = 0; i < N; i++) {
+#pragma HLS UNROLL
+	 key[i] = paddedKey[i];
+	 payload[i] = paddedPayload[i];
+      }
+   }
+
+   template<class Key>
+   static void sort(Key key[N]) {
+#pragma HLS INLINE
+      Key paddedKey[NPadded];
+#pragma HLS ARRAY_PARTITION variable=paddedKey complete dim=0
+      for(int i = 0; i < NPadded; i++) {
+#pragma HLS UNROLL
+	 paddedKey[i] = i < N ? key[i] : SortPadding<Key, Descending>::key();
+      }
+
+      Network::apply(paddedKey, (NoPayload *) 0);
+
+      for(int i = 0; i < N; i++) {
+#pragma HLS UNROLL
+	 key[i] = paddedKey[i];
+      }
+   }
+};
+
+// Largest power of two below N
+template<int N>
+struct PrevPow2 {
+   static const int value = NextPow2<N>::value / 2;
+};
+
+template<class Key, class Payload>
+inline void swapEntries(Key key[], Payload payload[], int i, int l) {
+#pragma HLS INLINE
+   Key k = key[i];
+   key[i] = key[l];
+   key[l] = k;
+   swapPayload(payload, i, l);
+}
+
+// Bitonic merge of the N entries from First: the first ones sorted in the final
+// direction, the others in the opposite one
+template<int First, int N, bool Descending>
+struct BitonicMerge {
+   static const int M = PrevPow2<N>::value;
+   typedef BitonicMerge<First, N - M, Descending> Head;
+   typedef BitonicMerge<First + N - M, M, Descending> Tail;
+   static const int NComparators = N - M + Head::NComparators + Tail::NComparators;
+   static const int NStages = 1 + (Head::NStages > Tail::NStages ? Head::NStages : Tail::NStages);
+
+   template<class Key, class Payload>
+   static void apply(Key key[], Payload payload[]) {
+#pragma HLS INLINE
+      for(int i = First; i < First + N - M; i++) {
+#pragma HLS UNROLL
+	 compareExchange<Descending>(key, payload, i, i + M);
+      }
+      Head::apply(key, payload);
+      Tail::apply(key, payload);
+   }
+};
+
+template<int First, bool Descending>
+struct BitonicMerge<First, 1, Descending> {
+   static const int NComparators = 0;
+   static const int NStages = 0;
+
+   template<class Key, class Payload>
+   static void apply(Key *, Payload *) {}
+};
+
+// Selection of the K first of the N entries from First, left sorted from First
+template<int First, int N, int K, bool Descending>
+struct BitonicTopK {
+   static const int NA = N / 2;
+   static const int NB = N - NA;
+   static const int LA = NA < K ? NA : K;
+   static const int LB = NB < K ? NB : K;
+   static const int L = LA + LB < K ? LA + LB : K;
+   // Entries of the first list compared with one of the second
+   static const int FirstCompared = L > LB ? L - LB : 0;
+   static const int NDiscard = LA - FirstCompared;
+
+   typedef BitonicTopK<First, NA, K, Descending> A;
+   typedef BitonicTopK<First + NA, NB, K, Descending> B;
+   typedef BitonicMerge<First, L, Descending> Merge;
+   static const int NComparators = A::NComparators + B::NComparators + NDiscard + Merge::NComparators;
+   static const int NStages = (A::NStages > B::NStages ? A::NStages : B::NStages)
+      + (NDiscard > 0) + Merge::NStages;
+
+   template<class Key, class Payload>
+   static void apply(Key key[], Payload payload[]) {
+#pragma HLS INLINE
+      A::apply(key, payload);
+      B::apply(key, payload);
+      // The larger of entry i of the first list and entry L - 1 - i of the second
+      // ends up in the first
+      for(int i = FirstCompared; i < LA; i++) {
+#pragma HLS UNROLL
+	 compareExchange<Descending>(key, payload, First + i, First + NA + L - 1 - i);
+      }
+      // Entries L - 1 - i of the second list for i >= LA (all of the first list
+      // is kept, LA = NA), reversed in place
+      for(int i = 0; i < (L - LA) / 2; i++) {
+#pragma HLS UNROLL
+	 swapEntries(key, payload, First + NA + i, First + L - 1 - i);
+      }
+      Merge::apply(key, payload);
+   }
+};
+
+template<int First, int K, bool Descending>
+struct BitonicTopK<First, 1, K, Descending> {
+   static const int NComparators = 0;
+   static const int NStages = 0;
+
+   template<class Key, class Payload>
+   static void apply(Key *, Payload *) {}
+};
+
+template<int N, int K, bool Descending = true>
+struct BitonicSelector {
+   typedef char KAtMostN[(K >= 1 && K <= N) ? 1 : -1];
+
+   typedef BitonicTopK<0, N, K, Descending> Network;
+   static const int NComparators = Network::NComparators;
+   static const int NStages = Network::NStages;
+
+   template<class Key, class Payload>
+   static void select(Key key[N], Payload payload[N]) {
+#pragma HLS INLINE
+      Network::apply(key, payload);
+   }
+
+   template<class Key>
+   static void select(Key key[N]) {
+#pragma HLS INLINE
+      Network::apply(key, (NoPayload *) 0);
+   }
+};
+
+template<int NLists, int L, bool Descending = true>
+struct SortedListMerger {
+   static const int N = NLists * L;
+   static const int NComparators = L * L * NLists * (NLists - 1) / 2;
+
+   template<class Key, class Payload>
+   static void merge(const Key key[N], const Payload payload[N], Key outKey[N], Payload outPayload[N]) {
+#pragma HLS INLINE
+      for(int e = 0; e < N; e++) {
+#pragma HLS UNROLL
+	 int list = e / L;
+	 int position = e % L;
+	 for(int o = 0; o < N; o++) {
+#pragma HLS UNROLL
+	    int oList = o / L;
+	    // entries of earlier lists go first on equal keys, those of later lists after
+	    if(oList < list)
+	       position += Descending ? !(key[o] < key[e]) : !(key[e] < key[o]);
+	    else if(oList > list)
+	       position += Descending ? (key[e] < key[o]) : (key[o] < key[e]);
+	 }
+	 outKey[position] = key[e];
+	 movePayload(outPayload, position, payload, e);
+      }
+   }
+
+   template<class Key, class Payload>
+   static void mergeSequential(const Key key[N], const Payload payload[N], Key outKey[N], Payload outPayload[N]) {
+      int head[NLists];
+      for(int list = 0; list < NLists; list++)
+	 head[list] = list * L;
+      for(int o = 0; o < N; o++) {
+	 int best = -1;
+	 for(int list = 0; list < NLists; list++) {
+	    if(head[list] == (list + 1) * L)
+	       continue;
+	    if(best < 0 || (Descending ? (key[best] < key[head[list]]) : (key[head[list]] < key[best])))
+	       best = head[list];
+	 }
+	 outKey[o] = key[best];
+	 movePayload(outPayload, o, payload, best);
+	 head[best / L]++;
+      }
+   }
+
+   template<class Key>
+   static void merge(const Key key[N], Key outKey[N]) {
+#pragma HLS INLINE
+      merge(key, (const NoPayload *) 0, outKey, (NoPayload *) 0);
+   }
+
+   template<class Key>
+   static void mergeSequential(const Key key[N], Key outKey[N]) {
+      mergeSequential(key, (const NoPayload *) 0, outKey, (NoPayload *) 0);
+   }
+};
+
+#endif
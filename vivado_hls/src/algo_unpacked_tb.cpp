@@ -8,8 +8,7 @@
 #include <iomanip>
 #include <string>
 
-#include "../../../../../APx_Gen0_Algo/VivadoHls/null_algo_unpacked/vivado_hls/src/algo_unpacked.h"
-//#include "algo_unpacked.h"
+#include "algo_unpacked.h"
 
 using namespace std;
 